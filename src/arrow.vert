@@ -0,0 +1,25 @@
+#version 330 core
+
+// one instance per moving block: arrow from center of block along shift
+
+layout (location = 0) in vec3 aArrow;  // vertex of glyph: along shift (0 tail, 1 tip), back from tip, side
+layout (location = 1) in vec2 aBlock;  // per instance: coordinates of block in grid
+layout (location = 2) in vec2 aShift;  // per instance: shift of block in pixels of analysis image
+
+uniform vec2 imageSize;   // pixels of displayed image
+uniform float blockSize;  // pixels of displayed image
+uniform float shiftScale; // analysis pixels to displayed pixels
+
+void main()
+{
+	vec2 shift = aShift * shiftScale;
+	float len = length(shift);
+	vec2 direction = shift / len;        // zero shift culled on CPU
+	vec2 side = vec2(-direction.y, direction.x);
+	float head = min(0.4 * len, 0.4 * blockSize);
+
+	vec2 center = (aBlock + 0.5) * blockSize;
+	vec2 position = center + shift * aArrow.x - direction * head * aArrow.y + side * head * aArrow.z;
+
+	gl_Position = vec4(position / imageSize * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -14,30 +14,94 @@
 
 typedef struct blk {
 	COORD_2D shift;
-	double diff;
+	double diff; // cost of found shift: mean absolute difference of pixels (0..255)
 	int last_update; // 0:  recently updated;        >0 (1, 2, 3, ...): updated in previous iteration;
+	COORD_2D seed;   // start point of search from motion vectors of codec (valid for current frame only)
+	int seeded;
 } BLK;
 
+// sum of motion vectors of codec covering block (see seed_from_motion_vectors in capture.c)
+typedef struct seed_sum {
+	double x;
+	double y;
+	int counter;
+} SEED_SUM;
+
+#define FLOW_STATS_DIRECTIONS 8 // sectors of 45 degrees: 0 === right, 2 === up (image bottom-up), 4 === left, 6 === down
+#define FLOW_STATS_BINS 8       // magnitude of shift: [0..1], (1..2], (2..4], ... (32..64], > 64
+
+enum search_mode {
+	SEARCH_FULL, // all shifts around search center
+	SEARCH_EPZS  // predictive zonal search: candidates from neighbours, then small pattern
+};
+
+// summary of frame, computed by last pass of block_matching_optimized_images
+typedef struct flow_stats {
+	unsigned long int moving;  // blocks with non-zero shift
+	double mean_x;             // mean shift of moving blocks (in pixels of analysis image)
+	double mean_y;
+	int dominant_direction;    // most frequent sector of moving blocks, -1 === no motion
+	unsigned long int magnitude_histogram[FLOW_STATS_BINS];
+	COORD_2DU bbox_min;        // bounding box of moving blocks (in blocks), valid if moving > 0
+	COORD_2DU bbox_max;
+	unsigned long int stale;   // blocks not measured long time (last_update > long_time_without_update)
+	double mean_age;           // mean last_update of all blocks
+	COORD_2D global_shift;     // global motion (camera ego-motion) of frame, zero if not estimated
+	unsigned long int local_moving; // blocks with shift different from global shift (residual local motion)
+	double local_mean_x;       // mean residual shift (shift - global_shift) of local moving blocks
+	double local_mean_y;
+} FLOW_STATS;
+
+// leaf of adaptive partition (quadtree): node searched as one large block, shift stored in all covered blocks
+typedef struct quadtree_leaf {
+	COORD_2DU block; // bottom left covered block (in blocks)
+	int size;        // in blocks (1 === one block of grid)
+	COORD_2D shift;
+	double diff;     // cost of found shift
+} QUADTREE_LEAF;
+
 typedef struct optical_flow {
 	int block_size_in_pixel;
 	int max_shift_global; // shift_global === previoush shift
 	int max_shift_local; // shift_local === distance from shift_global for search similar
+	int max_shift_local_per_frame; // for neighbouring frames; max_shift_local grow with distance between processed frames
+	int frame_distance; // between current and previous processed frames (in frames of source)
+	int seed_radius; // search distance around seed (motion vector of codec)
 	double epsilon;
 	double histogram_epsilon;
 	double threshold;
 	int min_neighbours;
 	int long_time_without_update;
 	int painted_by_neighbor;
+	int search_mode; // see enum search_mode
+	unsigned long int cost_evaluations; // calls of diff_block by search (statistics)
+	int global_motion; // estimate global motion of frame and search blocks around it
+	COORD_2D global_shift; // of current frame (samples searched around global shift of previous frame)
+	int quadtree_size_in_pixel; // root of adaptive partition (block_size_in_pixel * 2^n), 0 === uniform grid of blocks
+	QUADTREE_LEAF* leaves; // of current frame, at most array_size
+	unsigned long int leaf_count;
 
 	unsigned long int width;
 	unsigned long int height;
 	unsigned long int array_size;
 	BLK* array;
+	SEED_SUM* seed_sum; // accumulator of seeds, array_size
+
+	unsigned long int frame_counter; // number of frames with calculated optical flow
+	FLOW_STATS stats;                // of last processed frame
 
 	struct imgRawImage* raw_image;
 	struct imgRawImage* gui_image;
-	struct imgRawImage* old_image;
+	struct imgRawImage* old_image; // previous (or first) image, owned by flow
+	struct imgRawImage* spare_image; // replaced old image, buffer reused for next frame (owned by flow)
+	struct imgRawImage* display_image; // full resolution source for gui_image
+
+	int warm_up; // frame processed only for warm up of context (overlap of segments): result not saved
+	int recording; // frame written into outputs (false: event mode without motion, see event-recorder.c)
+
+	int analysis_scale; // optical flow calculated on image reduced in analysis_scale times: block and shift in display pixels = analysis_scale * (block and shift)
 
+	int time_bounded; // false === all blocks searched once per frame, semaphore_optical_flow not used (benchmark)
 	_Atomic int semaphore_optical_flow;
 } OPTICAL_FLOW;
 
@@ -33,6 +33,7 @@ Code:
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <stdio.h>
@@ -73,12 +74,20 @@ int init_block_matching (int image_width, int image_height, int block_size, int
 	flow->block_size_in_pixel = block_size;
 	flow->max_shift_global = max_shift_global;
 	flow->max_shift_local = max_shift_local;
+	flow->max_shift_local_per_frame = max_shift_local;
+	flow->frame_distance = 1;
 	flow->epsilon = epsilon;
 	flow->histogram_epsilon = histogram_epsilon;
 	flow->threshold = threshold;
 	flow->min_neighbours = min_neighbours;
 	flow->long_time_without_update = long_time_without_update;
 	flow->painted_by_neighbor = painted_by_neighbor;
+	extern int search_mode; // fixme: global variable
+	flow->search_mode = search_mode;
+	flow->cost_evaluations = 0;
+	extern int global_motion; // fixme: global variable
+	flow->global_motion = global_motion;
+	flow->global_shift = (COORD_2D) {0, 0};
 
 	flow->width = get_block_numbers (image_width,  block_size);
 	flow->height = get_block_numbers (image_height, block_size);
@@ -89,8 +98,44 @@ int init_block_matching (int image_width, int image_height, int block_size, int
 		flow->array[i].last_update = OPTICAL_FLOW_JUST_UPDATED;
 		flow->array[i].shift.x = 0;
 		flow->array[i].shift.y = 0;
+		flow->array[i].diff = 0.0;
+		flow->array[i].seeded = false;
 	}
-
+	flow->seed_sum = NULL;
+	extern int quadtree_size; // fixme: global variable
+	flow->quadtree_size_in_pixel = 0;
+	flow->leaves = NULL;
+	flow->leaf_count = 0;
+	if (quadtree_size >= 2 * block_size) {
+		flow->leaves = (QUADTREE_LEAF*) malloc(sizeof(QUADTREE_LEAF) * flow->array_size);
+		if (flow->leaves == NULL) {
+			printf("ERROR could not allocate leaves of quadtree: %lu blocks\n", flow->array_size);
+			return -1;
+		}
+		// root: block_size * 2^n
+		flow->quadtree_size_in_pixel = block_size;
+		while (flow->quadtree_size_in_pixel * 2 <= quadtree_size) flow->quadtree_size_in_pixel *= 2;
+	}
+	flow->seed_sum = (SEED_SUM*) malloc(sizeof(SEED_SUM) * flow->array_size);
+	if (flow->seed_sum == NULL) {
+		printf("ERROR could not allocate seeds: %lu blocks\n", flow->array_size);
+		return -1;
+	}
+	flow->seed_radius = OPTICAL_FLOW_SEED_RADIUS;
+
+	flow->frame_counter = 0;
+	memset(&flow->stats, 0, sizeof(FLOW_STATS));
+	flow->stats.dominant_direction = -1;
+	flow->analysis_scale = 1;
+	flow->warm_up = false;
+	flow->recording = true;
+	flow->raw_image = NULL;
+	flow->gui_image = NULL;
+	flow->old_image = NULL;
+	flow->spare_image = NULL;
+	flow->display_image = NULL;
+
+	flow->time_bounded = true;
 	atomic_init(&flow->semaphore_optical_flow, true);
 
 	return 0;
@@ -98,9 +143,78 @@ int init_block_matching (int image_width, int image_height, int block_size, int
 
 
 
+/**
+   Objects move further between distant frames (skipped frames, keyframes only),
+   so search range grow with distance.
+*/
+void set_frame_distance (OPTICAL_FLOW* flow, int frame_distance)
+{
+	flow->frame_distance = MAX(frame_distance, 1);
+	flow->max_shift_local = MIN(flow->max_shift_local_per_frame * flow->frame_distance,
+				    MAX(OPTICAL_FLOW_MAX_SHIFT_LOCAL_LIMIT, flow->max_shift_local_per_frame));
+}
+
+
+
+/**
+   Search around motion vector of codec (if exist for this block in current frame)
+   in small radius, else around previous shift of block
+   (or around global motion of frame: local motion of block is small residual).
+*/
+COORD_2D get_search_center (OPTICAL_FLOW* flow, unsigned long int raw_flow_coord, int *max_shift_local)
+{
+	if (flow->array[raw_flow_coord].seeded) {
+		*max_shift_local = flow->seed_radius;
+		return flow->array[raw_flow_coord].seed;
+	}
+	*max_shift_local = flow->max_shift_local;
+	if (flow->global_motion) return flow->global_shift;
+	return flow->array[raw_flow_coord].shift;
+}
+
+
+
 void free_block_matching (OPTICAL_FLOW* flow)
 {
 	free(flow->array);
+	free(flow->seed_sum);
+	free(flow->leaves);
+	if (flow->old_image != NULL) {
+		free(flow->old_image->lpData);
+		free(flow->old_image);
+		flow->old_image = NULL;
+	}
+	if (flow->spare_image != NULL) {
+		free(flow->spare_image->lpData);
+		free(flow->spare_image);
+		flow->spare_image = NULL;
+	}
+}
+
+
+
+/**
+   One line per frame: number of moving blocks and their mean shift (in display pixels),
+   dominant direction, bounding box of motion (in blocks) and stale blocks (see FLOW_STATS)
+*/
+void print_flow_summary (FILE *fp, int frame_number, double frame_time, OPTICAL_FLOW* flow)
+{
+	FLOW_STATS* stats = &flow->stats;
+	fprintf(fp, "frame %d time %.3f moving %lu/%lu mean shift [%.2f %.2f] direction %d bbox [%lu %lu %lu %lu] stale %lu\n",
+		frame_number, frame_time, stats->moving, flow->array_size,
+		stats->mean_x * flow->analysis_scale, stats->mean_y * flow->analysis_scale,
+		stats->dominant_direction,
+		stats->bbox_min.x, stats->bbox_min.y, stats->bbox_max.x, stats->bbox_max.y,
+		stats->stale);
+	if (flow->global_motion) {
+		fprintf(fp, "\tglobal [%ld %ld] local moving %lu mean shift [%.2f %.2f]\n",
+			stats->global_shift.x * flow->analysis_scale, stats->global_shift.y * flow->analysis_scale,
+			stats->local_moving,
+			stats->local_mean_x * flow->analysis_scale, stats->local_mean_y * flow->analysis_scale);
+	}
+	if (flow->quadtree_size_in_pixel > 0) {
+		fprintf(fp, "\tleaves %lu (root %d pixels)\n", flow->leaf_count, flow->quadtree_size_in_pixel * flow->analysis_scale);
+	}
 }
 
 
@@ -180,7 +294,7 @@ double diff_block (struct imgRawImage* old_image, struct imgRawImage* new_image,
 		coord_2d_old.y = block.y + ny;
 		coord_2d_new.y = block.y + ny + shift.y;
 
-		nx = 0;
+		nx = MAX(0, -(block.x + shift.x)); // first pixel of row inside new image (left edge)
 		coord_2d_old.x = block.x + nx;
 		coord_2d_new.x = block.x + nx + shift.x;
 
@@ -191,20 +305,20 @@ double diff_block (struct imgRawImage* old_image, struct imgRawImage* new_image,
 		if (coord_raw_old >= 0 && coord_raw_new >= 0) {
 
 
-			for (nx = 0; nx < block_size; nx++) {
-				coord_raw_old += nx * old_image->numComponents;
-				coord_raw_new += nx * old_image->numComponents;
-				if (coord_raw_old <= (long long int)old_image->dwBufferBytes &&
-				    coord_raw_new <= (long long int)new_image->dwBufferBytes) {
-					for (unsigned int color = 0; color < new_image->numComponents; color++) {
+			// pixels of row inside both images (large block can cross right edge)
+			int row_length = MIN(block_size - nx, MIN((long int)old_image->width - coord_2d_old.x,
+								  (long int)new_image->width - coord_2d_new.x));
+			for (nx = 0; nx < row_length; nx++) {
+				long long int pixel_old = coord_raw_old + nx * old_image->numComponents;
+				long long int pixel_new = coord_raw_new + nx * new_image->numComponents;
+				for (unsigned int color = 0; color < new_image->numComponents; color++) {
 #ifdef DEBUG
-						gui_image->lpData[coord_raw_old + color] += 20;
-						gui_image->lpData[coord_raw_new + color] += 1;
+					gui_image->lpData[pixel_old + color] += 20;
+					gui_image->lpData[pixel_new + color] += 1;
 #endif
-						sum += abs( (int)(old_image->lpData[coord_raw_old + color]) -
-							    (int)(new_image->lpData[coord_raw_new + color]));
-						counter++;
-					}
+					sum += abs( (int)(old_image->lpData[pixel_old + color]) -
+						    (int)(new_image->lpData[pixel_new + color]));
+					counter++;
 				}
 			}
 		}
@@ -225,11 +339,13 @@ static int cmp_double(const void * a, const void * b)
 
 /**
    Find block correlation with all possible shifts
+
+   \param cost difference of block with found shift (or with zero shift if result zero)
 */
-COORD_2D find_block_correlation (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
-				 COORD_2D block, int block_size,
-				 COORD_2D shift_global, int max_shift_local,
-				 OPTICAL_FLOW* flow)
+static COORD_2D full_search (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
+			     COORD_2D block, int block_size,
+			     COORD_2D shift_global, int max_shift_local,
+			     OPTICAL_FLOW* flow, double *cost)
 {
 	double result;
 	COORD_2D shift = {0, 0};
@@ -237,13 +353,18 @@ COORD_2D find_block_correlation (struct imgRawImage* old_image, struct imgRawIma
 	int counter = 0;
 	COORD_2D best_shift = shift;
 	double min_result = diff_block (old_image, new_image, gui_image, block, shift, block_size);
+	double zero_result = min_result;
 	HISTOGRAM_STORAGE histogram[SQUARE(max_shift_local * 2 + 2)];
 	histogram[counter].diff = min_result;
 	histogram[counter].shift.x = 0;
 	histogram[counter].shift.y = 0;
 	counter++;
 
-	if (min_result < flow->epsilon) return best_shift;
+	if (min_result < flow->epsilon) {
+		*cost = zero_result;
+		flow->cost_evaluations++;
+		return best_shift;
+	}
 
 	for (int j = shift_global.y - max_shift_local; j <= shift_global.y + max_shift_local; j++) {
 		for (int i = shift_global.x - max_shift_local; i <= shift_global.x + max_shift_local; i++) {
@@ -257,12 +378,17 @@ COORD_2D find_block_correlation (struct imgRawImage* old_image, struct imgRawIma
 		}
 	}
 
+	flow->cost_evaluations += counter;
+
 	qsort(histogram, counter, sizeof(HISTOGRAM_STORAGE), cmp_double); // h[0] = max; h[counter-1] = min
 	double median = histogram[counter/2].diff;
 	min_result = histogram[counter - 1].diff;
 	best_shift = histogram[counter - 1].shift;
 
-	if (median - min_result < flow->threshold) return (COORD_2D) {0, 0};
+	if (median - min_result < flow->threshold) {
+		*cost = zero_result;
+		return (COORD_2D) {0, 0};
+	}
 
 	int i = counter - 1;
 	double best_distance = sqrt(SQUARE(histogram[i].shift.x) + SQUARE(histogram[i].shift.y));
@@ -279,6 +405,171 @@ COORD_2D find_block_correlation (struct imgRawImage* old_image, struct imgRawIma
 		i--;
 	}
 
+	*cost = min_result;
+	return best_shift;
+}
+
+
+
+/**
+   Find block correlation with all possible shifts, cost (diff) of found shift stored in block
+*/
+COORD_2D find_block_correlation (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
+				 COORD_2D block, int block_size,
+				 COORD_2D shift_global, int max_shift_local,
+				 OPTICAL_FLOW* flow)
+{
+	double cost;
+	COORD_2D best_shift = full_search (old_image, new_image, gui_image, block, block_size, shift_global, max_shift_local, flow, &cost);
+
+	long long int raw_flow_coord = coord_to_raw_flow(flow, (COORD_2DU) {.x = block.x / block_size, .y = block.y / block_size});
+	if (raw_flow_coord >= 0) flow->array[raw_flow_coord].diff = cost;
+	return best_shift;
+}
+
+
+
+static long int median3 (long int a, long int b, long int c)
+{
+	return MAX(MIN(a, b), MIN(MAX(a, b), c));
+}
+
+
+
+/**
+   Candidate of predictive search: cost of shift limited by search window (each shift evaluated once),
+   best candidate replaced if cost less (equal cost: nearest to zero shift, as in find_block_correlation)
+*/
+static void epzs_candidate (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
+			    COORD_2D block, int block_size, COORD_2D shift, COORD_2D shift_global, int max_shift_local,
+			    HISTOGRAM_STORAGE *histogram, int *counter, COORD_2D *best_shift, double *min_result, OPTICAL_FLOW* flow)
+{
+	shift.x = MIN(MAX(shift.x, shift_global.x - max_shift_local), shift_global.x + max_shift_local);
+	shift.y = MIN(MAX(shift.y, shift_global.y - max_shift_local), shift_global.y + max_shift_local);
+	for (int i = 0; i < *counter; i++) {
+		if (shift.x == histogram[i].shift.x && shift.y == histogram[i].shift.y) return;
+	}
+
+	double result = diff_block (old_image, new_image, gui_image, block, shift, block_size);
+	flow->cost_evaluations++;
+	histogram[*counter].diff = result;
+	histogram[*counter].shift = shift;
+	(*counter)++;
+
+	if (result < *min_result - flow->histogram_epsilon ||
+	    (result < *min_result + flow->histogram_epsilon &&
+	     SQUARE(shift.x) + SQUARE(shift.y) < SQUARE(best_shift->x) + SQUARE(best_shift->y))) {
+		*min_result = result;
+		*best_shift = shift;
+	}
+}
+
+
+
+/**
+   Enhanced predictive zonal search (EPZS): instead of all (2 * max_shift_local + 1)^2 shifts
+   only candidates are checked --- zero, search center (previous shift or motion vector of codec),
+   current shifts of left, previous row and previous row right neighbours, and median of them.
+   Search stopped if cost of best candidate less than adaptive threshold (by cost of neighbours),
+   else refined by small diamond pattern around best candidate.
+
+   Texture test as in find_block_correlation, but on evaluated shifts only (candidates and at least
+   one diamond around best): median cost - min cost < flow->threshold === block without texture, zero shift.
+
+   Result limited by same window as find_block_correlation.
+
+   \param neighbour raw flow coord of left, previous row and previous row right neighbours (< 0 === outside)
+   \param cost difference of block with found shift (or with zero shift if result zero)
+*/
+static COORD_2D epzs_search (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
+			     COORD_2D block, int block_size,
+			     COORD_2D shift_global, int max_shift_local,
+			     long long int neighbour[3], OPTICAL_FLOW* flow, double *cost)
+{
+	COORD_2D best_shift = {0, 0};
+	double zero_result = diff_block (old_image, new_image, gui_image, block, best_shift, block_size);
+	double min_result = zero_result;
+	flow->cost_evaluations++;
+
+	*cost = zero_result;
+	if (min_result < flow->epsilon) return best_shift;
+
+	// evaluated shifts: zero, 5 candidates, 4 per step of diamond
+	HISTOGRAM_STORAGE histogram[1 + 5 + 4 * (2 * max_shift_local + 1)];
+	int counter = 0;
+	histogram[counter].diff = zero_result;
+	histogram[counter].shift = best_shift;
+	counter++;
+
+	// neighbours (image bottom-up: previous row === below)
+	COORD_2D predictor[3];
+	double threshold = -1.0; // min cost of neighbours
+	for (int n = 0; n < 3; n++) {
+		predictor[n] = (COORD_2D) {0, 0};
+		if (neighbour[n] >= 0) {
+			predictor[n] = flow->array[neighbour[n]].shift;
+			if (threshold < 0.0 || flow->array[neighbour[n]].diff < threshold) threshold = flow->array[neighbour[n]].diff;
+		}
+	}
+	threshold = OPTICAL_FLOW_EPZS_FACTOR * MAX(threshold, 0.0) + OPTICAL_FLOW_EPZS_OFFSET;
+
+	COORD_2D candidate[5] = {
+		{.x = median3(predictor[0].x, predictor[1].x, predictor[2].x),
+		 .y = median3(predictor[0].y, predictor[1].y, predictor[2].y)},
+		shift_global,
+		predictor[0], predictor[1], predictor[2]};
+
+	for (int c = 0; c < 5 && min_result >= threshold; c++) {
+		epzs_candidate (old_image, new_image, gui_image, block, block_size, candidate[c], shift_global, max_shift_local,
+				histogram, &counter, &best_shift, &min_result, flow);
+	}
+
+	// refine: small diamond around best candidate while cost decrease (path limited by size of window),
+	// first diamond always: costs around minimum needed by texture test
+	COORD_2D diamond[4] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+	for (int step = 0; step < 2 * max_shift_local + 1 && (step == 0 || min_result >= threshold); step++) {
+		COORD_2D center = best_shift;
+		for (int d = 0; d < 4; d++) {
+			epzs_candidate (old_image, new_image, gui_image, block, block_size,
+					(COORD_2D) {.x = center.x + diamond[d].x, .y = center.y + diamond[d].y},
+					shift_global, max_shift_local, histogram, &counter, &best_shift, &min_result, flow);
+		}
+		if (best_shift.x == center.x && best_shift.y == center.y) break;
+	}
+
+	// without texture (minimum not deeper than median of evaluated costs): zero
+	qsort(histogram, counter, sizeof(HISTOGRAM_STORAGE), cmp_double); // h[0] = max; h[counter-1] = min
+	double median = histogram[counter/2].diff;
+	if (median - min_result < flow->threshold) return (COORD_2D) {0, 0};
+
+	*cost = min_result;
+	return best_shift;
+}
+
+
+
+/**
+   Predictive search of block (see epzs_search), cost (diff) of found shift stored in block
+*/
+COORD_2D find_block_correlation_epzs (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
+				      COORD_2D block, int block_size,
+				      COORD_2D shift_global, int max_shift_local,
+				      OPTICAL_FLOW* flow)
+{
+	// neighbours: left, previous row, previous row right
+	long long int i = block.x / block_size;
+	long long int j = block.y / block_size;
+	long long int neighbour[3] = {
+		coord_to_raw_flow(flow, (COORD_2DU) {.x = i - 1, .y = j}),
+		coord_to_raw_flow(flow, (COORD_2DU) {.x = i,     .y = j - 1}),
+		coord_to_raw_flow(flow, (COORD_2DU) {.x = i + 1, .y = j - 1})};
+
+	double cost;
+	COORD_2D best_shift = epzs_search (old_image, new_image, gui_image, block, block_size, shift_global, max_shift_local,
+					   neighbour, flow, &cost);
+
+	long long int raw_flow_coord = coord_to_raw_flow(flow, (COORD_2DU) {.x = i, .y = j});
+	if (raw_flow_coord >= 0) flow->array[raw_flow_coord].diff = cost;
 	return best_shift;
 }
 
@@ -294,6 +585,7 @@ void block_matching_full_images (struct imgRawImage* old_image, struct imgRawIma
 	COORD_2D block;
 	COORD_2DU pixel;
 	long long int coord_raw;
+	long long int source_raw;
 
 	RGB_COLOR color_shift;
 	int max_shift = sqrt(2.0 * (double)SQUARE (flow->max_shift_global + flow->max_shift_local));
@@ -311,11 +603,18 @@ void block_matching_full_images (struct imgRawImage* old_image, struct imgRawIma
 				for(pixel.y = block.y; pixel.y < (unsigned long int)(block.y + flow->block_size_in_pixel); pixel.y++) {
 					for(pixel.x = block.x; pixel.x < (unsigned long int)(block.x + flow->block_size_in_pixel); pixel.x++) {
 						coord_raw = coord_to_raw_chunk(gui_image, pixel);
-						if (coord_raw >= 0) {
-							RGB_COLOR source_color = {
-								.r = new_image->lpData[coord_raw + R],
-								.g = new_image->lpData[coord_raw + G],
-								.b = new_image->lpData[coord_raw + B]};
+						source_raw = coord_to_raw_chunk(new_image, pixel); // gray source have one component
+						if (coord_raw >= 0 && source_raw >= 0) {
+							RGB_COLOR source_color;
+							if (new_image->numComponents == 1) {
+								unsigned char gray = new_image->lpData[source_raw];
+								source_color = (RGB_COLOR) {.r = gray, .g = gray, .b = gray};
+							} else {
+								source_color = (RGB_COLOR) {
+									.r = new_image->lpData[source_raw + R],
+									.g = new_image->lpData[source_raw + G],
+									.b = new_image->lpData[source_raw + B]};
+							}
 							color_shift = shift_to_color (source_color, coord_shift, max_shift);
 							gui_image->lpData[coord_raw + R] = color_shift.r;
 							gui_image->lpData[coord_raw + G] = color_shift.g;
@@ -331,6 +630,192 @@ void block_matching_full_images (struct imgRawImage* old_image, struct imgRawIma
 
 
 
+/**
+   Search of block in images of flow by selected algorithm (flow->search_mode)
+*/
+static COORD_2D search_block_correlation (OPTICAL_FLOW* flow, COORD_2D block, COORD_2D search_center, int max_shift_local)
+{
+	if (flow->search_mode == SEARCH_EPZS) {
+		return find_block_correlation_epzs (flow->old_image, flow->raw_image, flow->gui_image,
+						    block, flow->block_size_in_pixel,
+						    search_center, max_shift_local, flow);
+	}
+	return find_block_correlation (flow->old_image, flow->raw_image, flow->gui_image,
+				       block, flow->block_size_in_pixel,
+				       search_center, max_shift_local, flow);
+}
+
+
+
+/**
+   Global motion (camera ego-motion: shake, pan) of frame: blocks of sparse grid
+   searched around previous global shift in wide window (max_shift_global),
+   global shift === dominant peak of their non-zero shifts (support: shifts within one pixel),
+   if peak supported by enough samples, else zero (static camera, or motion of objects only).
+   Full search used for samples in any search mode: shift can be far from predictors.
+   Searched blocks stored as just updated.
+*/
+static void estimate_global_motion (OPTICAL_FLOW* flow)
+{
+	unsigned long int step = MAX(1, (unsigned long int)sqrt((double)flow->array_size / OPTICAL_FLOW_GLOBAL_SAMPLES));
+	unsigned long int samples_max = ((flow->width + step - 1) / step) * ((flow->height + step - 1) / step);
+	COORD_2D *sample = (COORD_2D*) malloc(sizeof(COORD_2D) * samples_max);
+	if (sample == NULL) return; // global shift of previous frame used
+
+	unsigned long int samples = 0;
+	unsigned long int moving = 0; // samples with non-zero shift (stored in array)
+	for (unsigned long int j = step / 2; j < flow->height; j += step) {
+		for (unsigned long int i = step / 2; i < flow->width; i += step) {
+			long long int raw_flow_coord = coord_to_raw_flow(flow, (COORD_2DU) {.x = i, .y = j});
+			if (raw_flow_coord < 0) continue;
+			COORD_2D block = {.x = i * flow->block_size_in_pixel, .y = j * flow->block_size_in_pixel};
+			COORD_2D shift = find_block_correlation (flow->old_image, flow->raw_image, flow->gui_image,
+								 block, flow->block_size_in_pixel,
+								 flow->global_shift, flow->max_shift_global, flow);
+			flow->array[raw_flow_coord].shift = shift;
+			flow->array[raw_flow_coord].last_update = OPTICAL_FLOW_JUST_UPDATED;
+			samples++;
+			if (shift.x != 0 || shift.y != 0) sample[moving++] = shift;
+		}
+	}
+
+	COORD_2D peak = {0, 0};
+	unsigned long int peak_support = 0;
+	for (unsigned long int a = 0; a < moving; a++) {
+		unsigned long int support = 0;
+		for (unsigned long int b = 0; b < moving; b++) {
+			if (labs(sample[a].x - sample[b].x) <= 1 && labs(sample[a].y - sample[b].y) <= 1) support++;
+		}
+		if (support > peak_support) {
+			peak_support = support;
+			peak = sample[a];
+		}
+	}
+
+	// most frequent shift of peak
+	unsigned long int peak_count = 0;
+	COORD_2D peak_center = peak;
+	for (unsigned long int a = 0; a < moving; a++) {
+		if (labs(sample[a].x - peak_center.x) > 1 || labs(sample[a].y - peak_center.y) > 1) continue;
+		unsigned long int count = 0;
+		for (unsigned long int b = 0; b < moving; b++) {
+			if (sample[a].x == sample[b].x && sample[a].y == sample[b].y) count++;
+		}
+		if (count > peak_count) {
+			peak_count = count;
+			peak = sample[a];
+		}
+	}
+	free(sample);
+
+	flow->global_shift = (peak_support >= OPTICAL_FLOW_GLOBAL_MIN_SUPPORT * samples && peak_support > 0) ? peak : (COORD_2D) {0, 0};
+}
+
+
+
+/**
+   Node of adaptive partition (quadtree): searched as one large block, split into four nodes
+   if cost of found shift high in any quadrant, or previous shifts of covered blocks disagree
+   with it (motion boundary). Shift of leaf stored in all covered blocks.
+   Node searched by search mode of flow: full search of node of size^2 blocks costs as size^2 blocks
+   for every shift of window, predictive search (EPZS) only few shifts (neighbours of node as predictors).
+
+   \param origin bottom left block of node (in blocks)
+   \param size in blocks (power of 2)
+*/
+static void quadtree_node (OPTICAL_FLOW* flow, COORD_2DU origin, int size)
+{
+	long long int raw_flow_coord = coord_to_raw_flow(flow, origin);
+	if (raw_flow_coord < 0) return; // node outside of grid (right or top edge)
+
+	int max_shift_local;
+	COORD_2D search_center = get_search_center(flow, raw_flow_coord, &max_shift_local);
+	COORD_2D block = {.x = origin.x * flow->block_size_in_pixel, .y = origin.y * flow->block_size_in_pixel};
+	COORD_2D shift;
+	double cost;
+
+	if (size == 1) {
+		shift = search_block_correlation (flow, block, search_center, max_shift_local);
+		cost = flow->array[raw_flow_coord].diff;
+	} else if (flow->search_mode == SEARCH_EPZS) {
+		// neighbours: left, previous row, previous row right (of node)
+		long long int neighbour[3] = {
+			coord_to_raw_flow(flow, (COORD_2DU) {.x = origin.x - 1,    .y = origin.y}),
+			coord_to_raw_flow(flow, (COORD_2DU) {.x = origin.x,        .y = origin.y - 1}),
+			coord_to_raw_flow(flow, (COORD_2DU) {.x = origin.x + size, .y = origin.y - 1})};
+		shift = epzs_search (flow->old_image, flow->raw_image, flow->gui_image,
+				     block, size * flow->block_size_in_pixel,
+				     search_center, max_shift_local, neighbour, flow, &cost);
+	} else {
+		shift = full_search (flow->old_image, flow->raw_image, flow->gui_image,
+				     block, size * flow->block_size_in_pixel,
+				     search_center, max_shift_local, flow, &cost);
+	}
+	if (size > 1) {
+		// residual of small object not diluted by large node: cost of quadrants
+		int half = size / 2;
+		int split = false;
+		for (int q = 0; q < 4 && !split; q++) {
+			COORD_2D quadrant = {.x = block.x + (q % 2) * half * flow->block_size_in_pixel,
+					     .y = block.y + (q / 2) * half * flow->block_size_in_pixel};
+			split = (diff_block (flow->old_image, flow->raw_image, flow->gui_image,
+					     quadrant, shift, half * flow->block_size_in_pixel) > OPTICAL_FLOW_QUADTREE_SPLIT_COST);
+			flow->cost_evaluations++;
+		}
+		for (int j = 0; j < size && !split; j++) {
+			for (int i = 0; i < size && !split; i++) {
+				long long int covered = coord_to_raw_flow(flow, (COORD_2DU) {.x = origin.x + i, .y = origin.y + j});
+				if (covered >= 0 &&
+				    (labs(flow->array[covered].shift.x - shift.x) > OPTICAL_FLOW_QUADTREE_DISAGREEMENT ||
+				     labs(flow->array[covered].shift.y - shift.y) > OPTICAL_FLOW_QUADTREE_DISAGREEMENT)) {
+					split = true;
+				}
+			}
+		}
+
+		if (split) {
+			quadtree_node (flow, origin, half);
+			quadtree_node (flow, (COORD_2DU) {.x = origin.x + half, .y = origin.y}, half);
+			quadtree_node (flow, (COORD_2DU) {.x = origin.x,        .y = origin.y + half}, half);
+			quadtree_node (flow, (COORD_2DU) {.x = origin.x + half, .y = origin.y + half}, half);
+			return;
+		}
+	}
+
+	for (int j = 0; j < size; j++) {
+		for (int i = 0; i < size; i++) {
+			long long int covered = coord_to_raw_flow(flow, (COORD_2DU) {.x = origin.x + i, .y = origin.y + j});
+			if (covered >= 0) {
+				flow->array[covered].shift = shift;
+				flow->array[covered].diff = cost;
+				flow->array[covered].last_update = OPTICAL_FLOW_JUST_UPDATED;
+			}
+		}
+	}
+	flow->leaves[flow->leaf_count++] = (QUADTREE_LEAF) {.block = origin, .size = size, .shift = shift, .diff = cost};
+}
+
+
+
+/**
+   Adaptive partition: static and uniform motion areas by large blocks (rows of roots of quadtree),
+   leaves stored in flow->leaves
+
+   \param time_bounded rows of roots searched only while time left (semaphore_optical_flow)
+*/
+void quadtree_partition (OPTICAL_FLOW* flow, int time_bounded)
+{
+	unsigned long int root = flow->quadtree_size_in_pixel / flow->block_size_in_pixel; // in blocks
+	flow->leaf_count = 0;
+	for (unsigned long int j = 0; j < flow->height && (!time_bounded || atomic_load(&(flow->semaphore_optical_flow))); j += root) {
+		for (unsigned long int i = 0; i < flow->width; i += root) {
+			quadtree_node (flow, (COORD_2DU) {.x = i, .y = j}, root);
+		}
+	}
+}
+
+
+
 void *block_matching_optimized_images (void *vin)
 {
 	OPTICAL_FLOW* flow = vin;
@@ -357,14 +842,35 @@ void *block_matching_optimized_images (void *vin)
 
 
 
-	// find in previous success blocks
+	int max_shift_local;
+	COORD_2D search_center;
+
+	if (flow->global_motion) {
+		estimate_global_motion (flow);
+		printf("global [%ld %ld] ", flow->global_shift.x, flow->global_shift.y);
+	}
+
+	if (flow->quadtree_size_in_pixel > 0) {
+		quadtree_partition (flow, flow->time_bounded);
+		printf("leaves %lu ", flow->leaf_count);
+	}
+
+	// find in previous success blocks (and in blocks moved by motion vectors of codec),
+	// blocks covered by leaf of quadtree (just updated) keep shift of leaf: flow->array agree with flow->leaves
 	for (unsigned long int raw_flow_coord = 0; raw_flow_coord < flow->array_size; raw_flow_coord++) {
+		if (flow->quadtree_size_in_pixel > 0 && flow->array[raw_flow_coord].last_update == OPTICAL_FLOW_JUST_UPDATED) {
+			continue;
+		}
 		if ((flow->array[raw_flow_coord].last_update == OPTICAL_FLOW_UPDATED_IN_PREVIOUS_ITERATION &&
 		     !(flow->array[raw_flow_coord].shift.x == 0 && flow->array[raw_flow_coord].shift.y == 0)) ||
+		    (flow->array[raw_flow_coord].seeded &&
+		     !(flow->array[raw_flow_coord].seed.x == 0 && flow->array[raw_flow_coord].seed.y == 0)) ||
 		     flow->array[raw_flow_coord].last_update > OPTICAL_FLOW_LONG_TIME_WITHOUT_UPDATE) { // update those that have not been updated for a long time
-			    coord_shift = find_block_correlation (flow->old_image, flow->raw_image, flow->gui_image,
-								  block, flow->block_size_in_pixel,
-								  flow->array[raw_flow_coord].shift, flow->max_shift_local, flow);
+			    COORD_2DU block_coord = raw_flow_to_coord(flow, raw_flow_coord);
+			    block.x = block_coord.x * flow->block_size_in_pixel;
+			    block.y = block_coord.y * flow->block_size_in_pixel;
+			    search_center = get_search_center(flow, raw_flow_coord, &max_shift_local);
+			    coord_shift = search_block_correlation (flow, block, search_center, max_shift_local);
 			    flow->array[raw_flow_coord].shift = coord_shift;
 			    flow->array[raw_flow_coord].last_update = OPTICAL_FLOW_JUST_UPDATED;
 			    counter++;
@@ -413,26 +919,34 @@ void *block_matching_optimized_images (void *vin)
 
 	printf("%d:", counter);
 
-	// process random block
+	// process random block (benchmark: all blocks not updated yet, in order, not bounded by time)
 	counter = 0;
+	unsigned long int next_block = 0;
 	do {
-		int i = rnd(0, horizontal_blocks_num - 1);
-		int j = rnd(0, vertical_blocks_num - 1);
+		int i, j;
+		if (flow->time_bounded) {
+			i = rnd(0, horizontal_blocks_num - 1);
+			j = rnd(0, vertical_blocks_num - 1);
+		} else {
+			if (next_block >= flow->array_size) break;
+			COORD_2DU block_coord = raw_flow_to_coord(flow, next_block++);
+			i = block_coord.x;
+			j = block_coord.y;
+		}
 		int raw_flow_coord = coord_to_raw_flow(flow, (COORD_2DU) {.x=i, .y=j});
 		if (raw_flow_coord >= 0 &&
 		    flow->array[raw_flow_coord].last_update != OPTICAL_FLOW_JUST_UPDATED) {
 			block.x = i * flow->block_size_in_pixel;
 			block.y = j * flow->block_size_in_pixel;
 
-			coord_shift = find_block_correlation (flow->old_image, flow->raw_image, flow->gui_image,
-							      block, flow->block_size_in_pixel,
-							      flow->array[raw_flow_coord].shift, flow->max_shift_local, flow); // generate a lot of trivial: shift(x,y) === 0
+			search_center = get_search_center(flow, raw_flow_coord, &max_shift_local);
+			coord_shift = search_block_correlation (flow, block, search_center, max_shift_local); // generate a lot of trivial: shift(x,y) === 0
 			flow->array[raw_flow_coord].shift = coord_shift;
 			flow->array[raw_flow_coord].last_update = OPTICAL_FLOW_JUST_UPDATED;
 			counter++;
 		}
 
-	} while (atomic_load(&(flow->semaphore_optical_flow)));
+	} while (!flow->time_bounded || atomic_load(&(flow->semaphore_optical_flow)));
 	printf("%d ", counter);
 
 	/*
@@ -478,22 +992,80 @@ void *block_matching_optimized_images (void *vin)
 	}
 */
 
+	// age of blocks, and statistics of frame in same pass
+	FLOW_STATS stats;
+	unsigned long int directions[FLOW_STATS_DIRECTIONS] = {0};
+	double sum_age = 0.0;
+	memset(&stats, 0, sizeof(FLOW_STATS));
+	stats.bbox_min = (COORD_2DU) {.x = flow->width, .y = flow->height};
 	for (unsigned long int i = 0; i < flow->array_size; i++) {
-		flow->array[i].last_update += 1;
+		BLK* blk = &flow->array[i];
+		blk->last_update += 1;
+		sum_age += blk->last_update;
+		if (blk->last_update > flow->long_time_without_update) stats.stale++;
+		if (blk->shift.x != flow->global_shift.x || blk->shift.y != flow->global_shift.y) {
+			stats.local_mean_x += blk->shift.x - flow->global_shift.x;
+			stats.local_mean_y += blk->shift.y - flow->global_shift.y;
+			stats.local_moving++;
+		}
+		if (blk->shift.x == 0 && blk->shift.y == 0) continue;
+
+		COORD_2DU coord = raw_flow_to_coord(flow, i);
+		stats.bbox_min.x = MIN(stats.bbox_min.x, coord.x);
+		stats.bbox_min.y = MIN(stats.bbox_min.y, coord.y);
+		stats.bbox_max.x = MAX(stats.bbox_max.x, coord.x);
+		stats.bbox_max.y = MAX(stats.bbox_max.y, coord.y);
+		stats.mean_x += blk->shift.x;
+		stats.mean_y += blk->shift.y;
+		stats.moving++;
+
+		double magnitude = hypot(blk->shift.x, blk->shift.y);
+		int bin = (magnitude <= 1.0) ? 0 : (int)ceil(log2(magnitude));
+		stats.magnitude_histogram[MIN(bin, FLOW_STATS_BINS - 1)]++;
+		// sector centered on direction: 0 === [-22.5, 22.5) degrees
+		int sector = lround(atan2(blk->shift.y, blk->shift.x) / (2.0 * M_PI) * FLOW_STATS_DIRECTIONS);
+		directions[(sector + FLOW_STATS_DIRECTIONS) % FLOW_STATS_DIRECTIONS]++;
+	}
+	stats.dominant_direction = -1;
+	if (stats.moving > 0) {
+		stats.mean_x /= stats.moving;
+		stats.mean_y /= stats.moving;
+		stats.dominant_direction = 0;
+		for (int d = 1; d < FLOW_STATS_DIRECTIONS; d++) {
+			if (directions[d] > directions[stats.dominant_direction]) stats.dominant_direction = d;
+		}
+	} else {
+		stats.bbox_min = (COORD_2DU) {.x = 0, .y = 0};
 	}
+	stats.mean_age = (flow->array_size > 0) ? sum_age / flow->array_size : 0.0;
+	stats.global_shift = flow->global_shift;
+	if (stats.local_moving > 0) {
+		stats.local_mean_x /= stats.local_moving;
+		stats.local_mean_y /= stats.local_moving;
+	}
+	flow->stats = stats;
 
 
 
-	colorize(flow->raw_image, flow->gui_image, flow);
+	if (flow->gui_image != NULL) {
+		colorize(flow->display_image, flow->gui_image, flow);
+	}
 
 	return 0;
 }
 
 
 
+/**
+   new_image and gui_image have display resolution:
+   blocks found on analysis image (reduced in flow->analysis_scale times) drawn by scaled blocks
+   (color of shift not depend on scale: saturation === shift / max_shift)
+*/
 void colorize (struct imgRawImage* new_image, struct imgRawImage* gui_image, OPTICAL_FLOW* flow)
 {
-	extern int hide_static_block;
+	extern _Atomic int hide_static_block;
+
+	int block_size = flow->block_size_in_pixel * flow->analysis_scale;
 
 	int horizontal_blocks_num = flow->width;
 	int vertical_blocks_num   = flow->height;
@@ -502,6 +1074,7 @@ void colorize (struct imgRawImage* new_image, struct imgRawImage* gui_image, OPT
 	COORD_2D block;
 	COORD_2DU pixel;
 	long long int coord_raw;
+	long long int source_raw;
 
 	RGB_COLOR color_shift;
 
@@ -509,9 +1082,9 @@ void colorize (struct imgRawImage* new_image, struct imgRawImage* gui_image, OPT
 
 	coord_shift = (COORD_2D) {.x=0, .y=0};
 	for (int j=0; j < vertical_blocks_num; j++) {
-		block.y = j * flow->block_size_in_pixel;
+		block.y = j * block_size;
 		for (int i=0; i < horizontal_blocks_num; i++) {
-			block.x = i * flow->block_size_in_pixel;
+			block.x = i * block_size;
 			int raw_flow_coord = coord_to_raw_flow(flow, (COORD_2DU) {.x=i, .y=j});
 			if (raw_flow_coord >= 0) {
 				coord_shift = flow->array[raw_flow_coord].shift;
@@ -545,17 +1118,24 @@ void colorize (struct imgRawImage* new_image, struct imgRawImage* gui_image, OPT
 				}
 				*/
 
-				for(pixel.y = block.y; pixel.y < (unsigned long int)(block.y + flow->block_size_in_pixel); pixel.y++) {
-					for(pixel.x = block.x; pixel.x < (unsigned long int)(block.x + flow->block_size_in_pixel); pixel.x++) {
+				for(pixel.y = block.y; pixel.y < (unsigned long int)(block.y + block_size); pixel.y++) {
+					for(pixel.x = block.x; pixel.x < (unsigned long int)(block.x + block_size); pixel.x++) {
 						coord_raw = coord_to_raw_chunk(gui_image, pixel);
-						if (coord_raw >= 0) {
-							RGB_COLOR source_color = {
-								.r = new_image->lpData[coord_raw + R],
-								.g = new_image->lpData[coord_raw + G],
-								.b = new_image->lpData[coord_raw + B]};
+						source_raw = coord_to_raw_chunk(new_image, pixel); // gray source have one component
+						if (coord_raw >= 0 && source_raw >= 0) {
+							RGB_COLOR source_color;
+							if (new_image->numComponents == 1) {
+								unsigned char gray = new_image->lpData[source_raw];
+								source_color = (RGB_COLOR) {.r = gray, .g = gray, .b = gray};
+							} else {
+								source_color = (RGB_COLOR) {
+									.r = new_image->lpData[source_raw + R],
+									.g = new_image->lpData[source_raw + G],
+									.b = new_image->lpData[source_raw + B]};
+							}
 							if (coord_shift.x == 0 && coord_shift.y == 0) {
 								unsigned char mono = monochrome(source_color);
-								if (hide_static_block == true) {
+								if (atomic_load(&hide_static_block) == true) {
 									mono = (mono>>2) + 255 - (255>>2);
 								}
 								gui_image->lpData[coord_raw + R] = mono;
@@ -592,7 +1172,7 @@ void colorize (struct imgRawImage* new_image, struct imgRawImage* gui_image, OPT
 		coord_shift = flow->array[raw_flow_coord].shift;
 		if (coord_shift.x == 0 && coord_shift.y == 0) {
 			unsigned char mono = monochrome(source_color);
-			if (hide_static_block == true) {
+			if (atomic_load(&hide_static_block) == true) {
 				mono = (mono>>2) + 255 - (255>>2);
 			}
 			gui_image->lpData[coord_raw + R] = mono;
@@ -10,6 +10,8 @@
 #ifndef BLOCK_MATCHING_H
 #define BLOCK_MATCHING_H
 
+#include <stdio.h>
+
 #include "image-type.h"
 #include "block-matching-type.h"
 
@@ -17,15 +19,22 @@ long long int coord_to_raw_flow(OPTICAL_FLOW * flow, COORD_2DU coord);
 COORD_2DU raw_flow_to_coord(OPTICAL_FLOW* flow, unsigned long int r);
 void print_image (struct imgRawImage* image);
 int init_block_matching (int image_width, int image_height, int block_size, int max_shift_global, int max_shift_local, double epsilon, double histogram_epsilon, double threshold, int min_neighbours, int long_time_without_update, int painted_by_neighbor, OPTICAL_FLOW* flow);
+void set_frame_distance (OPTICAL_FLOW* flow, int frame_distance);
+COORD_2D get_search_center (OPTICAL_FLOW* flow, unsigned long int raw_flow_coord, int *max_shift_local);
 void free_block_matching (OPTICAL_FLOW* flow);
+void print_flow_summary (FILE *fp, int frame_number, double frame_time, OPTICAL_FLOW* flow);
 int get_block_numbers (int image_size, int block_size);
 double diff_block (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
 		   COORD_2D block, COORD_2D shift, int block_size);
 COORD_2D find_block_correlation (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
 				 COORD_2D block, int block_size, 
 				 COORD_2D shift_global, int max_shift_local, OPTICAL_FLOW* flow);
+COORD_2D find_block_correlation_epzs (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
+				      COORD_2D block, int block_size,
+				      COORD_2D shift_global, int max_shift_local, OPTICAL_FLOW* flow);
 void block_matching_full_images (struct imgRawImage* old_image, struct imgRawImage* new_image, struct imgRawImage* gui_image,
 				 OPTICAL_FLOW* flow);
+void quadtree_partition (OPTICAL_FLOW* flow, int time_bounded);
 void *block_matching_optimized_images (void *vin);
 void colorize (struct imgRawImage* new_image, struct imgRawImage* gui_image, OPTICAL_FLOW* flow);
 unsigned char monochrome (RGB_COLOR source_color);
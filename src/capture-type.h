@@ -0,0 +1,78 @@
+/** \file
+   capture-type.h --- header for capture.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef CAPTURE_TYPE_H
+#define CAPTURE_TYPE_H
+
+#include <libavformat/avformat.h>
+
+#include "mailbox-type.h"
+
+#define CAPTURE_AUTO -1
+
+typedef struct capture_options {
+	int thread_count; // decoder threads: 0 === one thread per core (ffmpeg decide)
+	int thread_type;  // FF_THREAD_FRAME, FF_THREAD_SLICE or CAPTURE_AUTO (select by input kind)
+	int low_delay;    // true, false or CAPTURE_AUTO (select by input kind)
+	int capture_thread; // read and decode in separate thread, process only latest frame: true, false or CAPTURE_AUTO
+
+	// demuxer
+	long int probesize;       // bytes: 0 === ffmpeg default
+	long int analyzeduration; // microseconds: CAPTURE_AUTO === ffmpeg default
+	int nobuffer;             // fflags nobuffer: not buffer packets on start (lower latency)
+	char *rtsp_transport;     // "tcp", "udp", ...; NULL === ffmpeg default
+	int skip_probe;           // not call avformat_find_stream_info (use parameters from header or width, height)
+	int width;                // known frame size of source (0 === unknown)
+	int height;
+
+	int analysis_scale; // optical flow calculated on frame reduced in analysis_scale times (1 === full resolution)
+
+	// frame skipping (offline throughput)
+	int every;             // process every n-th decoded frame (1 === all frames)
+	double time_stride;    // seconds between processed frames (0 === all frames)
+	int keyframes_only;    // decoder skip all frames except keyframes (AVDISCARD_NONKEY)
+
+	int codec_mv;          // start block search from motion vectors of codec (export_mvs)
+	int codec_mv_radius;   // search distance around motion vector of codec
+} CAPTURE_OPTIONS;
+
+typedef struct frame_select {
+	int every;
+	double time_stride;
+
+	AVRational time_base;  // of video stream
+	double frame_duration; // seconds (from frame rate of video stream), 0 === unknown
+
+	unsigned long int decoded;         // decoded frames counter
+	unsigned long int last_decoded;    // decoded counter of last processed frame
+	int64_t last_pts;                  // of last processed frame (AV_NOPTS_VALUE === no one processed)
+	int64_t last_time;                 // last_pts in microseconds (AV_NOPTS_VALUE === unknown)
+} FRAME_SELECT;
+
+typedef struct capture_thread_args {
+	AVFormatContext *pFormatContext;
+	AVCodecContext *pCodecContext;
+	int video_stream_index;
+	FRAME_MAILBOX* mailbox;
+	_Atomic int *stop;
+} CAPTURE_THREAD_ARGS;
+
+// processing thread: main thread own window and OpenGL context (see gui_display_loop)
+typedef struct mainloop_args {
+	char *dev_name;
+	int raw_format;                    // RAW_NONE === not raw input
+	int force_format;                  // V4L2_FORMAT_NONE === decoded by libav
+	int max_frame_count;
+	int compare_with_first;
+	int benchmark;                     // raw input: matching to completion, throughput printed
+	CAPTURE_OPTIONS* options;
+	unsigned int video_texture;
+} MAINLOOP_ARGS;
+
+#endif /* CAPTURE_TYPE_H */
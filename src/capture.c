@@ -68,24 +68,33 @@ Code:
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <time.h>
+#include <math.h>
 
 #include "capture.h"
 #include "gui.h"
 #include "const.h"
 #include "block-matching.h"
+#include "mailbox.h"
+#include "util.h"
 
 
 #define MAX_FNAME_LEN 128
 
 
 
-int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsigned int video_texture) {
-	extern int escape_status;
+int mainloop(char *file_name, int max_frame_count, int compare_with_first, CAPTURE_OPTIONS* options, unsigned int video_texture) {
+	extern _Atomic int escape_status;
 	int result;
 
+	// for "time to first optical flow frame" (startup and reconnect speed)
+	struct timespec ts_start;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
 	printf("initializing all the containers, codecs and protocols.\n");
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
 	av_register_all(); // av_register_all() deprecated since ffmpeg 4.0
@@ -103,6 +112,12 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 		return EXIT_FAILURE;
 	}
 
+	// abort blocking read (network timeout, camera reboot) when processing stopped
+	_Atomic int capture_stop;
+	atomic_init(&capture_stop, false);
+	pFormatContext->interrupt_callback.callback = capture_interrupt_callback;
+	pFormatContext->interrupt_callback.opaque = &capture_stop;
+
 
 	avdevice_register_all();
 	avformat_network_init();
@@ -114,7 +129,15 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 	// AVInputFormat (if you pass NULL it'll do the auto detect)
 	// and AVDictionary (which are options to the demuxer)
 	// http://ffmpeg.org/doxygen/trunk/group__lavf__decoding.html#ga31d601155e9035d5b0e7efedc894ee49
-	if ((result = avformat_open_input(&pFormatContext, file_name, NULL, NULL)) != 0) {
+	AVDictionary *demuxer_options = get_demuxer_options(options);
+	result = avformat_open_input(&pFormatContext, file_name, NULL, &demuxer_options);
+	// on return dictionary filled with options that were not found
+	AVDictionaryEntry *unused_option = NULL;
+	while ((unused_option = av_dict_get(demuxer_options, "", unused_option, AV_DICT_IGNORE_SUFFIX))) {
+		printf("demuxer option not used: %s=%s\n", unused_option->key, unused_option->value);
+	}
+	av_dict_free(&demuxer_options);
+	if (result != 0) {
 		printf("ERROR could not open the file: [%d] %s\n", result, av_err2str(result));
 		return EXIT_FAILURE;
 	}
@@ -124,21 +147,25 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 	// and some other information related to the format itself.
 	printf("format %s, duration %ld us, bit_rate %ld\n", pFormatContext->iformat->name, pFormatContext->duration, pFormatContext->bit_rate);
 
-	printf("finding stream info from format\n");
-	// read Packets from the Format to get stream information
-	// this function populates pFormatContext->streams
-	// (of size equals to pFormatContext->nb_streams)
-	// the arguments are:
-	// the AVFormatContext
-	// and options contains options for codec corresponding to i-th stream.
-	// On return each dictionary will be filled with options that were not found.
-	// https://ffmpeg.org/doxygen/trunk/group__lavf__decoding.html#gad42172e27cddafb81096939783b157bb
-	if (avformat_find_stream_info(pFormatContext, NULL) < 0) {
-		return EXIT_FAILURE;
-	}
+	if (options->skip_probe && set_known_stream_parameters(pFormatContext, options)) {
+		printf("skip finding stream info: use stream parameters from header\n");
+	} else {
+		printf("finding stream info from format\n");
+		// read Packets from the Format to get stream information
+		// this function populates pFormatContext->streams
+		// (of size equals to pFormatContext->nb_streams)
+		// the arguments are:
+		// the AVFormatContext
+		// and options contains options for codec corresponding to i-th stream.
+		// On return each dictionary will be filled with options that were not found.
+		// https://ffmpeg.org/doxygen/trunk/group__lavf__decoding.html#gad42172e27cddafb81096939783b157bb
+		if (avformat_find_stream_info(pFormatContext, NULL) < 0) {
+			return EXIT_FAILURE;
+		}
 
-	// Dump information about file onto standard error
-	av_dump_format(pFormatContext, 0, file_name, 0);
+		// Dump information about file onto standard error
+		av_dump_format(pFormatContext, 0, file_name, 0);
+	}
 
 
 
@@ -174,7 +201,7 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 
 		if (pLocalCodec==NULL) {
 			printf("ERROR unsupported codec!\n");
-			return -1;
+			continue; // without full probe (--skip-probe) codec of audio stream can be unknown
 		}
 
 		// when the stream is a video we store its index, codec parameters and codec
@@ -216,12 +243,33 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 		return -1;
 	}
 
+	int live_input = is_live_input(file_name, pFormatContext);
+
+	// threading must be configured before avcodec_open2
+	set_decoder_threading(pCodecContext, options, live_input);
+
+	if (options->keyframes_only) {
+		pCodecContext->skip_frame = AVDISCARD_NONKEY; // not decode (and not process) other frames
+		printf("decode keyframes only\n");
+	}
+
+	AVDictionary *codec_options = NULL;
+	if (options->codec_mv) {
+		av_dict_set(&codec_options, "flags2", "+export_mvs", 0); // motion vectors as side data of frame (H.264, HEVC, MPEG-4, ...)
+	}
+
 	// Initialize the AVCodecContext to use the given AVCodec.
 	// https://ffmpeg.org/doxygen/trunk/group__lavc__core.html#ga11f785a188d7d9df71621001465b0f1d
-	if (avcodec_open2(pCodecContext, pCodec, NULL) < 0) {
+	result = avcodec_open2(pCodecContext, pCodec, &codec_options);
+	av_dict_free(&codec_options);
+	if (result < 0) {
 		printf("failed to open codec through avcodec_open2\n");
 		return -1;
 	}
+	printf("decoder threads: %d, active thread type: %s%s\n", pCodecContext->thread_count,
+	       (pCodecContext->active_thread_type & FF_THREAD_FRAME) ? "frame" :
+	       (pCodecContext->active_thread_type & FF_THREAD_SLICE) ? "slice" : "none",
+	       (pCodecContext->flags & AV_CODEC_FLAG_LOW_DELAY) ? ", low delay" : "");
 
 	// https://ffmpeg.org/doxygen/trunk/structAVFrame.html
 	AVFrame *pFrame = av_frame_alloc();
@@ -240,47 +288,30 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 
 	///////////////////////////////// start prepare to convert YCbCr to RGB format (YCbCr is often confused with the YUV) //////////////////////////////////////////
 
-	struct SwsContext *sws_ctx;
-	sws_ctx = sws_getContext
-		(
-			pCodecContext->width,
-			pCodecContext->height,
-			pCodecContext->pix_fmt,
-			pCodecContext->width,
-			pCodecContext->height,
-			AV_PIX_FMT_RGB24,
-			SWS_BILINEAR,
-			NULL,
-			NULL,
-			NULL
-			);
+	// created by first decoded frame (see process_frame): without full stream probe
+	// pixel format can be unknown until decoding
+	struct SwsContext *sws_ctx = NULL;
 
 
-	AVFrame *pFrameRGB = av_frame_alloc();
 	int num_components = NUM_COMPONENTS_RGB; // fixme: can ffmpeg decode monochrome video (-pix_fmt gray)?
 
-	//int num_bytes = avpicture_get_size(AV_PIX_FMT_RGB24, pCodecContext->width, pCodecContext->height); //https://stackoverflow.com/questions/12831761/how-to-resize-a-picture-using-ffmpegs-sws-scale
-	//avpicture_fill((AVPicture*)pFrameRGB, frame_buffer_RGB, AV_PIX_FMT_RGB24, pCodecContext->width, pCodecContext->height);  //deprecated use av_image_fill_arrays() instead.
-
-	int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, pCodecContext->width, pCodecContext->height, 1); //https://stackoverflow.com/questions/35678041/what-is-linesize-alignment-meaning
-
-	unsigned char* frame_buffer_RGB = (uint8_t*)av_malloc(num_bytes);
-
-	response = av_image_fill_arrays(pFrameRGB->data,       //uint8_t *dst_data[4],
-					pFrameRGB->linesize,   //int dst_linesize[4],
-					frame_buffer_RGB,      //const uint8_t * src,
-					AV_PIX_FMT_RGB24,      //enum AVPixelFormat pix_fmt,
-					pCodecContext->width,  //int width,
-					pCodecContext->height, //int height,
-					1);                    //int align);
-
-	if (response < 0) {
-		printf("av_image_fill_arrays Failed, response = %d\n", response);
+	// optical flow calculated on reduced analysis frame (4-16 times less work for scale 2-4),
+	// result drawn on full resolution display frame
+	int analysis_scale = MAX(options->analysis_scale, 1);
+	unsigned char* frame_buffer_RGB = NULL;
+	AVFrame *pFrameRGB = alloc_rgb_frame(MAX(pCodecContext->width / analysis_scale, 1),
+					     MAX(pCodecContext->height / analysis_scale, 1),
+					     &frame_buffer_RGB);
+
+	struct SwsContext *sws_ctx_display = NULL;
+	unsigned char* frame_buffer_display = NULL;
+	AVFrame *pFrameDisplay = NULL; // NULL === same as pFrameRGB
+	if (analysis_scale > 1) {
+		pFrameDisplay = alloc_rgb_frame(pCodecContext->width, pCodecContext->height, &frame_buffer_display);
+		printf("analysis resolution %d x %d (display %d x %d)\n",
+		       pFrameRGB->width, pFrameRGB->height, pFrameDisplay->width, pFrameDisplay->height);
 	}
 
-	pFrameRGB->width = pCodecContext->width;
-	pFrameRGB->height = pCodecContext->height;
-
 	///////////////////////////////// end prepare to convert YCbCr to RGB format (YCbCr is often confused with the YUV) //////////////////////////////////////////
 
 	OPTICAL_FLOW flow;
@@ -292,34 +323,56 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 			     OPTICAL_FLOW_LONG_TIME_WITHOUT_UPDATE,
 			     OPTICAL_FLOW_PAINTED_BY_NEIGHBOR,
 			     &flow);
+	flow.analysis_scale = analysis_scale;
+	if (options->codec_mv) {
+		flow.seed_radius = options->codec_mv_radius;
+		printf("search around motion vectors of codec, radius %d\n", flow.seed_radius);
+	}
 
-	// fill the Packet with data from the Stream
-	// https://ffmpeg.org/doxygen/trunk/group__lavf__decoding.html#ga4fdb3084415a82e3810de6ee60e46a61
-	int ret;
-	int frame_counter = 0;
-	while ((ret = av_read_frame(pFormatContext, pPacket)) >= 0 &&
-	       max_frame_count != 0 && escape_status == false) { // max_frame_count == -1 infinity; > 0 limited frame number; == 0 exit
-		// if it's the video stream
-		if (pPacket->stream_index == video_stream_index) {
-			//printf("AVPacket->pts %ld\n", pPacket->pts);
-			response = decode_packet(pPacket, pCodecContext, pFrame, pFrameRGB, sws_ctx, compare_with_first, video_texture, num_components, &flow);
-
-			if (response < 0)
-				break;
+	FRAME_SELECT select;
+	init_frame_select(&select, options, pFormatContext->streams[video_stream_index]);
+
+	int use_capture_thread = (options->capture_thread == CAPTURE_AUTO) ? live_input : options->capture_thread;
+	if (use_capture_thread) {
+		mainloop_capture_thread(pFormatContext, pCodecContext, video_stream_index, &capture_stop, &ts_start,
+					&select, max_frame_count, pFrameRGB, &sws_ctx, pFrameDisplay, &sws_ctx_display, compare_with_first, video_texture, num_components, &flow);
+	} else {
+		// fill the Packet with data from the Stream
+		// https://ffmpeg.org/doxygen/trunk/group__lavf__decoding.html#ga4fdb3084415a82e3810de6ee60e46a61
+		int ret;
+		int frame_counter = 0;
+		int first_flow_reported = false;
+		while ((ret = av_read_frame(pFormatContext, pPacket)) >= 0 &&
+		       max_frame_count != 0 && atomic_load(&escape_status) == false) { // max_frame_count == -1 infinity; > 0 limited frame number; == 0 exit
+			// if it's the video stream
+			if (pPacket->stream_index == video_stream_index) {
+				//printf("AVPacket->pts %ld\n", pPacket->pts);
+				response = decode_packet(pPacket, pCodecContext, &select, pFrame, pFrameRGB, &sws_ctx, pFrameDisplay, &sws_ctx_display, compare_with_first, video_texture, num_components, &flow);
+
+				if (response < 0)
+					break;
+				report_time_to_first_flow(&flow, &ts_start, &first_flow_reported);
+			}
+			// https://ffmpeg.org/doxygen/trunk/group__lavc__packet.html#ga63d5a489b419bd5d45cfd09091cbcbc2
+			av_packet_unref(pPacket);
+			printf(" %d=", frame_counter);
+			if (max_frame_count > 0) max_frame_count--;
+			frame_counter++;
 		}
-		// https://ffmpeg.org/doxygen/trunk/group__lavc__packet.html#ga63d5a489b419bd5d45cfd09091cbcbc2
-		av_packet_unref(pPacket);
-		printf(" %d=", frame_counter);
-		if (max_frame_count > 0) max_frame_count--;
-		frame_counter++;
 	}
 
 	printf("releasing all the resources\n");
 
 	free_block_matching (&flow);
+	sws_freeContext(sws_ctx);
 	avformat_close_input(&pFormatContext);
 	av_free(frame_buffer_RGB);
 	av_frame_free(&pFrameRGB);
+	if (pFrameDisplay != NULL) {
+		sws_freeContext(sws_ctx_display);
+		av_free(frame_buffer_display);
+		av_frame_free(&pFrameDisplay);
+	}
 	av_packet_free(&pPacket);
 	av_frame_free(&pFrame);
 	avcodec_free_context(&pCodecContext);
@@ -327,10 +380,120 @@ int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsig
 }
 
 
-int decode_packet(AVPacket *pPacket, AVCodecContext *pCodecContext, AVFrame *pFrame, AVFrame *pFrameRGB, struct SwsContext *sws_ctx, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow)
+/**
+   Demuxer options for fast startup of network streams:
+   full probe of RTSP stream can take some seconds before first frame
+*/
+AVDictionary *get_demuxer_options(CAPTURE_OPTIONS* options)
 {
-	extern int verbose;
+	AVDictionary *demuxer_options = NULL;
+
+	if (options->probesize > 0) av_dict_set_int(&demuxer_options, "probesize", options->probesize, 0);
+	if (options->analyzeduration >= 0) av_dict_set_int(&demuxer_options, "analyzeduration", options->analyzeduration, 0);
+	if (options->nobuffer) av_dict_set(&demuxer_options, "fflags", "nobuffer", 0);
+	if (options->rtsp_transport != NULL) av_dict_set(&demuxer_options, "rtsp_transport", options->rtsp_transport, 0);
+	if (options->width > 0 && options->height > 0) {
+		char video_size[32];
+		snprintf(video_size, sizeof(video_size), "%dx%d", options->width, options->height);
+		av_dict_set(&demuxer_options, "video_size", video_size, 0); // used by rawvideo and devices
+	}
+
+	return demuxer_options;
+}
+
+
+
+/**
+   For skip-probe mode: stream parameters from header (RTSP SDP, container)
+   or from command line (--size) must be enough for open decoder.
+
+   \return true if video stream parameters known
+*/
+int set_known_stream_parameters(AVFormatContext *pFormatContext, CAPTURE_OPTIONS* options)
+{
+	for (unsigned int i = 0; i < pFormatContext->nb_streams; i++) {
+		AVCodecParameters *pCodecParameters = pFormatContext->streams[i]->codecpar;
+		if (pCodecParameters->codec_type == AVMEDIA_TYPE_VIDEO &&
+		    pCodecParameters->codec_id != AV_CODEC_ID_NONE) {
+			if ((pCodecParameters->width <= 0 || pCodecParameters->height <= 0) &&
+			    options->width > 0 && options->height > 0) {
+				pCodecParameters->width = options->width;
+				pCodecParameters->height = options->height;
+			}
+			if (pCodecParameters->width > 0 && pCodecParameters->height > 0) return true;
+			printf("skip probe: unknown frame size of stream %u (use --size)\n", i);
+			return false;
+		}
+	}
+	printf("skip probe: video stream not found in header\n");
+	return false;
+}
+
+
+
+void report_time_to_first_flow(OPTICAL_FLOW* flow, struct timespec *ts_start, int *reported)
+{
+	if (*reported || flow->frame_counter == 0) return;
+
+	struct timespec ts_current;
+	clock_gettime(CLOCK_MONOTONIC, &ts_current);
+	printf("\ntime to first optical flow frame: %.3f s\n",
+	       (double)(ts_current.tv_sec - ts_start->tv_sec) +
+	       (double)(ts_current.tv_nsec - ts_start->tv_nsec) / (double)NANOSECONDS_IN_SECOND);
+	*reported = true;
+}
+
+
 
+/**
+   Live input (camera, network stream) can not be read faster than
+   real time, so latency matters more than decoder throughput.
+*/
+int is_live_input(char *file_name, AVFormatContext *pFormatContext)
+{
+	const char *live_prefix[] = {"/dev/", "rtsp://", "rtsps://", "rtp://", "rtmp://", "udp://", "tcp://", "srt://"};
+
+	if (pFormatContext->iformat->flags & AVFMT_NOFILE) return true; // capture devices (v4l2, x11grab, ...)
+
+	for (unsigned int i = 0; i < sizeof(live_prefix) / sizeof(live_prefix[0]); i++) {
+		if (strncmp(file_name, live_prefix[i], strlen(live_prefix[i])) == 0) return true;
+	}
+	return false;
+}
+
+
+
+/**
+   Frame threading decodes N frames in parallel: best throughput (4K HEVC files),
+   but add N-1 frames of latency.
+   Slice threading decodes one frame by parallel slices: no additional latency (live RTSP),
+   but work only if encoder split frame to slices.
+*/
+void set_decoder_threading(AVCodecContext *pCodecContext, CAPTURE_OPTIONS* options, int live_input)
+{
+	int thread_type = options->thread_type;
+	int low_delay = options->low_delay;
+
+	if (thread_type == CAPTURE_AUTO) thread_type = live_input ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+	if (low_delay == CAPTURE_AUTO) low_delay = live_input;
+
+	pCodecContext->thread_count = options->thread_count;
+	pCodecContext->thread_type = thread_type;
+	if (low_delay) {
+		pCodecContext->flags |= AV_CODEC_FLAG_LOW_DELAY; // note: ffmpeg disable frame threading with this flag
+	}
+
+	printf("input %s: decoder thread_count = %d (0 === auto), thread_type = %s%s\n",
+	       live_input ? "live" : "file",
+	       options->thread_count,
+	       (thread_type == FF_THREAD_FRAME) ? "frame" : "slice",
+	       low_delay ? ", low delay" : "");
+}
+
+
+
+int decode_packet(AVPacket *pPacket, AVCodecContext *pCodecContext, FRAME_SELECT* select, AVFrame *pFrame, AVFrame *pFrameRGB, struct SwsContext **sws_ctx, AVFrame *pFrameDisplay, struct SwsContext **sws_ctx_display, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow)
+{
 	// Supply raw packet data as input to a decoder
 	// https://ffmpeg.org/doxygen/trunk/group__lavc__decoding.html#ga58bc4bf1e0ac59e27362597e467efff3
 	int response = avcodec_send_packet(pCodecContext, pPacket);
@@ -369,29 +532,343 @@ int decode_packet(AVPacket *pPacket, AVCodecContext *pCodecContext, AVFrame *pFr
 				);
 			*/
 
-			response = sws_scale(sws_ctx, (unsigned char const * const *)(pFrame->data), (pFrame->linesize),
-					     0, pCodecContext->height, pFrameRGB->data, pFrameRGB->linesize);
+			if (select_frame(select, pFrame, flow)) {
+				pFrameRGB->pts = select->last_time; // not copied by sws_scale
+				process_frame(pFrame, pCodecContext->frame_number, pFrameRGB, sws_ctx, pFrameDisplay, sws_ctx_display, compare_with_first, video_texture, num_components, flow);
+			}
+		}
+	}
+	return 0;
+}
+
 
-			if (response <= 0) {
-				printf("Error: sws_scale status = %d\n", response);
+
+void init_frame_select(FRAME_SELECT* select, CAPTURE_OPTIONS* options, AVStream *pStream)
+{
+	AVRational frame_rate = (pStream->avg_frame_rate.num > 0 && pStream->avg_frame_rate.den > 0) ?
+		pStream->avg_frame_rate : pStream->r_frame_rate;
+
+	select->every = MAX(options->every, 1);
+	select->time_stride = options->time_stride;
+	select->time_base = pStream->time_base;
+	select->frame_duration = (frame_rate.num > 0 && frame_rate.den > 0) ? 1.0 / av_q2d(frame_rate) : 0.0;
+	select->decoded = 0;
+	select->last_decoded = 0;
+	select->last_pts = AV_NOPTS_VALUE;
+	select->last_time = AV_NOPTS_VALUE;
+
+	if (select->every > 1) printf("process every %d frame\n", select->every);
+	if (select->time_stride > 0) printf("process one frame every %.3f s\n", select->time_stride);
+}
+
+
+
+/**
+   Skip frames for offline throughput (--every, --time-stride, keyframes only),
+   and set distance between processed frames: search range of optical flow grow with distance.
+
+   \return true if frame must be processed
+*/
+int select_frame(FRAME_SELECT* select, AVFrame *pFrame, OPTICAL_FLOW* flow)
+{
+	int64_t pts = (pFrame->best_effort_timestamp != AV_NOPTS_VALUE) ? pFrame->best_effort_timestamp : pFrame->pts;
+
+	select->decoded++;
+
+	if (select->last_decoded > 0) {
+		if ((select->decoded - select->last_decoded) < (unsigned long int)select->every) return false;
+		if (select->time_stride > 0 && pts != AV_NOPTS_VALUE && select->last_pts != AV_NOPTS_VALUE &&
+		    (double)(pts - select->last_pts) * av_q2d(select->time_base) < select->time_stride) return false;
+	}
+
+	// distance in frames of source: by timestamps (correct for keyframes only and lost frames), else by counter
+	int frame_distance = select->decoded - select->last_decoded;
+	if (select->frame_duration > 0 && pts != AV_NOPTS_VALUE && select->last_pts != AV_NOPTS_VALUE) {
+		frame_distance = lround((double)(pts - select->last_pts) * av_q2d(select->time_base) / select->frame_duration);
+	}
+	if (select->last_decoded > 0) {
+		set_frame_distance(flow, frame_distance);
+	}
+
+	select->last_decoded = select->decoded;
+	select->last_pts = pts;
+	select->last_time = (pts != AV_NOPTS_VALUE) ? llround((double)pts * av_q2d(select->time_base) * 1e6) : AV_NOPTS_VALUE;
+	return true;
+}
+
+
+
+/**
+   Convert decoded YCbCr frame to RGB, then find optical flow
+*/
+void process_frame(AVFrame *pFrame, int frame_number, AVFrame *pFrameRGB, struct SwsContext **sws_ctx, AVFrame *pFrameDisplay, struct SwsContext **sws_ctx_display, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow)
+{
+	extern int verbose;
+
+	if (convert_frame(pFrame, pFrameRGB, sws_ctx, (pFrameDisplay == NULL) ? SWS_BILINEAR : SWS_AREA) != 0) return;
+	seed_from_motion_vectors(pFrame, pFrameRGB->width, pFrameRGB->height, flow);
+	// display frame need only for drawing result
+	if (pFrameDisplay != NULL && verbose != VERBOSE_NO) {
+		if (convert_frame(pFrame, pFrameDisplay, sws_ctx_display, SWS_BILINEAR) != 0) return;
+	} else {
+		pFrameDisplay = NULL;
+	}
+
+	process_image(pFrameRGB, pFrameDisplay, frame_number, compare_with_first, verbose, video_texture, num_components, flow);
+	if ((verbose & VERBOSE_IMAGE) && flow->warm_up == false && flow->recording) {
+		AVFrame *pFrameSave = (pFrameDisplay != NULL) ? pFrameDisplay : pFrameRGB;
+		char frame_filename[MAX_FNAME_LEN];
+		/*
+		// save a grayscale frame into a .pgm file
+		snprintf(frame_filename, sizeof(frame_filename), "/tmp/%s-%d.pgm", "frame", frame_number);
+		if(pFrame->format != AV_PIX_FMT_YUV420P) {
+			printf("Maybe not grayscale generated");
+		}
+		save_gray_frame(pFrame->data[0], pFrame->linesize[0], pFrame->width, pFrame->height, frame_filename);
+		*/
+		//Write RGB output to PPM image file
+		snprintf(frame_filename, sizeof(frame_filename), "/tmp/%s-%d.ppm","frame", frame_number);
+		save_rgb_frame(pFrameSave->data[0], pFrameSave->linesize[0], pFrameSave->width, pFrameSave->height, frame_filename);
+	}
+}
+
+
+
+/**
+   Motion vectors of codec (exported by "flags2 +export_mvs") used as start point
+   of block search, so small search radius is enough.
+
+   Vector of codec point from block in reference frame (src) to block in current frame (dst),
+   shift of optical flow point from block in old image to block in new image: shift = dst - src
+   (only vectors from past reference frame used).
+   Image of optical flow is flipped by horizontal axis (see frame_to_image) and can be reduced (analysis_scale).
+*/
+void seed_from_motion_vectors(AVFrame *pFrame, int analysis_width, int analysis_height, OPTICAL_FLOW* flow)
+{
+	for (unsigned long int i = 0; i < flow->array_size; i++) {
+		flow->array[i].seeded = false;
+	}
+
+	AVFrameSideData *side_data = av_frame_get_side_data(pFrame, AV_FRAME_DATA_MOTION_VECTORS);
+	if (side_data == NULL) return; // keyframe, or export of motion vectors not enabled
+
+	const AVMotionVector *mvs = (const AVMotionVector *)side_data->data;
+	int mvs_num = side_data->size / sizeof(AVMotionVector);
+
+	double scale_x = (double)analysis_width / (double)pFrame->width;
+	double scale_y = (double)analysis_height / (double)pFrame->height;
+	int block_size = flow->block_size_in_pixel;
+
+	SEED_SUM *sum = flow->seed_sum; // allocated once by init_block_matching
+	if (sum == NULL) return;
+	memset(sum, 0, sizeof(SEED_SUM) * flow->array_size);
+
+	for (int m = 0; m < mvs_num; m++) {
+		const AVMotionVector *mv = &mvs[m];
+		if (mv->source >= 0) continue; // future reference (B-frame): distance unknown
+
+		double shift_x = (mv->dst_x - mv->src_x) * scale_x;
+		double shift_y = -(mv->dst_y - mv->src_y) * scale_y; // flipped image
+
+		// dst_x, dst_y: center of w x h block in current frame
+		int x0 = (mv->dst_x - mv->w / 2) * scale_x;
+		int x1 = (mv->dst_x + mv->w / 2) * scale_x;
+		int y0 = analysis_height - (mv->dst_y + mv->h / 2) * scale_y;
+		int y1 = analysis_height - (mv->dst_y - mv->h / 2) * scale_y;
+
+		for (int j = MAX(y0, 0) / block_size; j <= MIN(y1, analysis_height - 1) / block_size; j++) {
+			for (int i = MAX(x0, 0) / block_size; i <= MIN(x1, analysis_width - 1) / block_size; i++) {
+				long long int raw_flow_coord = coord_to_raw_flow(flow, (COORD_2DU) {.x=i, .y=j});
+				if (raw_flow_coord >= 0) {
+					sum[raw_flow_coord].x += shift_x;
+					sum[raw_flow_coord].y += shift_y;
+					sum[raw_flow_coord].counter++;
+				}
 			}
-			process_image(pFrameRGB, pCodecContext->frame_number, compare_with_first, verbose, video_texture, num_components, flow);
-			if (verbose & VERBOSE_IMAGE) {
-				char frame_filename[MAX_FNAME_LEN];
-				/*
-				// save a grayscale frame into a .pgm file
-				snprintf(frame_filename, sizeof(frame_filename), "/tmp/%s-%d.pgm", "frame", pCodecContext->frame_number);
-				if(pFrame->format != AV_PIX_FMT_YUV420P) {
-					printf("Maybe not grayscale generated");
+		}
+	}
+
+	for (unsigned long int i = 0; i < flow->array_size; i++) {
+		if (sum[i].counter > 0) {
+			// vectors point to previous decoded frame, processed frames can be more distant (see select_frame)
+			flow->array[i].seed.x = lround(sum[i].x / sum[i].counter * flow->frame_distance);
+			flow->array[i].seed.y = lround(sum[i].y / sum[i].counter * flow->frame_distance);
+			flow->array[i].seeded = true;
+		}
+	}
+}
+
+
+
+/**
+   Convert (and scale) decoded YCbCr frame to RGB frame
+*/
+int convert_frame(AVFrame *pFrame, AVFrame *pFrameRGB, struct SwsContext **sws_ctx, int sws_flags)
+{
+	*sws_ctx = sws_getCachedContext(*sws_ctx,
+					pFrame->width, pFrame->height, pFrame->format,
+					pFrameRGB->width, pFrameRGB->height, AV_PIX_FMT_RGB24,
+					sws_flags, NULL, NULL, NULL);
+	if (*sws_ctx == NULL) {
+		printf("Error: can not convert pixel format %d to RGB\n", pFrame->format);
+		return -1;
+	}
+
+	int response = sws_scale(*sws_ctx, (unsigned char const * const *)(pFrame->data), (pFrame->linesize),
+				 0, pFrame->height, pFrameRGB->data, pFrameRGB->linesize);
+
+	if (response <= 0) {
+		printf("Error: sws_scale status = %d\n", response);
+	}
+	return 0;
+}
+
+
+
+/**
+   RGB frame with own buffer (free buffer by av_free)
+*/
+AVFrame *alloc_rgb_frame(int width, int height, unsigned char** frame_buffer)
+{
+	AVFrame *pFrameRGB = av_frame_alloc();
+
+	//int num_bytes = avpicture_get_size(AV_PIX_FMT_RGB24, width, height); //https://stackoverflow.com/questions/12831761/how-to-resize-a-picture-using-ffmpegs-sws-scale
+	//avpicture_fill((AVPicture*)pFrameRGB, frame_buffer_RGB, AV_PIX_FMT_RGB24, width, height);  //deprecated use av_image_fill_arrays() instead.
+
+	int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, 1); //https://stackoverflow.com/questions/35678041/what-is-linesize-alignment-meaning
+
+	*frame_buffer = (uint8_t*)av_malloc(num_bytes);
+
+	int response = av_image_fill_arrays(pFrameRGB->data,       //uint8_t *dst_data[4],
+					    pFrameRGB->linesize,   //int dst_linesize[4],
+					    *frame_buffer,         //const uint8_t * src,
+					    AV_PIX_FMT_RGB24,      //enum AVPixelFormat pix_fmt,
+					    width,                 //int width,
+					    height,                //int height,
+					    1);                    //int align);
+
+	if (response < 0) {
+		printf("av_image_fill_arrays Failed, response = %d\n", response);
+	}
+
+	pFrameRGB->width = width;
+	pFrameRGB->height = height;
+
+	return pFrameRGB;
+}
+
+
+
+int capture_interrupt_callback(void *opaque)
+{
+	return atomic_load((_Atomic int *)opaque);
+}
+
+
+
+/**
+   Capture thread: read and decode packets as fast as source give them,
+   publish every decoded frame into mailbox (latest frame wins).
+*/
+void *capture_thread(void *vin)
+{
+	CAPTURE_THREAD_ARGS* args = vin;
+
+	AVPacket *pPacket = av_packet_alloc();
+	AVFrame *pFrame = av_frame_alloc();
+	if (!pPacket || !pFrame) {
+		printf("failed to allocated memory for capture thread\n");
+		av_packet_free(&pPacket);
+		av_frame_free(&pFrame);
+		mailbox_close(args->mailbox);
+		return NULL;
+	}
+
+	while (!atomic_load(args->stop) && av_read_frame(args->pFormatContext, pPacket) >= 0) {
+		if (pPacket->stream_index == args->video_stream_index) {
+			int response = avcodec_send_packet(args->pCodecContext, pPacket);
+			if (response < 0) {
+				printf("Error while sending a packet to the decoder: %s\n", av_err2str(response));
+			}
+			while (response >= 0) {
+				response = avcodec_receive_frame(args->pCodecContext, pFrame);
+				if (response >= 0) {
+					mailbox_publish(args->mailbox, pFrame);
+				} else if (response != AVERROR(EAGAIN) && response != AVERROR_EOF) {
+					printf("Error while receiving a frame from the decoder: %s\n", av_err2str(response));
 				}
-				save_gray_frame(pFrame->data[0], pFrame->linesize[0], pFrame->width, pFrame->height, frame_filename);
-				*/
-				//Write RGB output to PPM image file
-				snprintf(frame_filename, sizeof(frame_filename), "/tmp/%s-%d.ppm","frame", pCodecContext->frame_number);
-				save_rgb_frame(pFrameRGB->data[0], pFrameRGB->linesize[0], pFrameRGB->width, pFrameRGB->height, frame_filename);
 			}
 		}
+		av_packet_unref(pPacket);
+	}
+
+	mailbox_close(args->mailbox);
+	av_frame_free(&pFrame);
+	av_packet_free(&pPacket);
+	return NULL;
+}
+
+
+
+/**
+   For live input: decode in capture thread, process only freshest frame.
+   Frames decoded while previous frame processed are dropped, so latency not grow.
+*/
+int mainloop_capture_thread(AVFormatContext *pFormatContext, AVCodecContext *pCodecContext, int video_stream_index, _Atomic int *capture_stop, struct timespec *ts_start,
+			    FRAME_SELECT* select, int max_frame_count, AVFrame *pFrameRGB, struct SwsContext **sws_ctx, AVFrame *pFrameDisplay, struct SwsContext **sws_ctx_display, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow)
+{
+	extern _Atomic int escape_status;
+
+	FRAME_MAILBOX mailbox;
+	if (init_mailbox(&mailbox) != 0) return -1;
+
+	AVFrame *pFrame = av_frame_alloc();
+	if (!pFrame) {
+		printf("failed to allocated memory for AVFrame\n");
+		free_mailbox(&mailbox);
+		return -1;
+	}
+
+	CAPTURE_THREAD_ARGS args = {
+		.pFormatContext = pFormatContext,
+		.pCodecContext = pCodecContext,
+		.video_stream_index = video_stream_index,
+		.mailbox = &mailbox,
+		.stop = capture_stop
+	};
+	pthread_t thread_capture;
+	int result_code = pthread_create(&thread_capture, NULL, capture_thread, &args);
+	if (result_code) {
+		printf("failed to create capture thread\n");
+		av_frame_free(&pFrame);
+		free_mailbox(&mailbox);
+		return -1;
+	}
+	printf("capture thread started\n");
+
+	int frame_counter = 0;
+	int first_flow_reported = false;
+	while (max_frame_count != 0 && atomic_load(&escape_status) == false &&
+	       mailbox_take(&mailbox, pFrame) == 0) { // max_frame_count == -1 infinity; > 0 limited frame number; == 0 exit
+		if (select_frame(select, pFrame, flow)) {
+			frame_counter++;
+			pFrameRGB->pts = select->last_time; // not copied by sws_scale
+			process_frame(pFrame, frame_counter, pFrameRGB, sws_ctx, pFrameDisplay, sws_ctx_display, compare_with_first, video_texture, num_components, flow);
+		}
+		av_frame_unref(pFrame);
+		report_time_to_first_flow(flow, ts_start, &first_flow_reported);
+		printf(" %d=", frame_counter);
+		if (max_frame_count > 0) max_frame_count--;
 	}
+
+	atomic_store(capture_stop, true); // break av_read_frame by interrupt callback
+	pthread_join(thread_capture, NULL);
+
+	printf("capture thread: decoded %lu frames, processed %d, dropped %lu\n",
+	       mailbox.published, frame_counter, mailbox.dropped);
+
+	av_frame_free(&pFrame);
+	free_mailbox(&mailbox);
 	return 0;
 }
 
@@ -17,14 +17,32 @@
 #include <libavutil/imgutils.h>  // <-- Requiered for av_image_get_buffer_size
 #include <libavutil/opt.h> // for av_opt_set
 #include <libavdevice/avdevice.h>
+#include <libavutil/motion_vector.h>
+#include <time.h>
 
 #include "image-type.h"
 #include "block-matching-type.h"
-
-int mainloop(char *file_name, int max_frame_count, int compare_with_first, unsigned int video_texture);
+#include "capture-type.h"
+
+int mainloop(char *file_name, int max_frame_count, int compare_with_first, CAPTURE_OPTIONS* options, unsigned int video_texture);
+AVDictionary *get_demuxer_options(CAPTURE_OPTIONS* options);
+int set_known_stream_parameters(AVFormatContext *pFormatContext, CAPTURE_OPTIONS* options);
+void report_time_to_first_flow(OPTICAL_FLOW* flow, struct timespec *ts_start, int *reported);
+int is_live_input(char *file_name, AVFormatContext *pFormatContext);
+void set_decoder_threading(AVCodecContext *pCodecContext, CAPTURE_OPTIONS* options, int live_input);
 void save_gray_frame(unsigned char *buf,int wrap,int xsize,int ysize, char *filename);
 void save_rgb_frame(unsigned char* buf, int wrap, int xsize, int ysize, char* filename);
-int decode_packet(AVPacket *pPacket, AVCodecContext *pCodecContext, AVFrame *pFrame,AVFrame *pFrameRGB,struct SwsContext *sws_ctx, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow);
+void init_frame_select(FRAME_SELECT* select, CAPTURE_OPTIONS* options, AVStream *pStream);
+int select_frame(FRAME_SELECT* select, AVFrame *pFrame, OPTICAL_FLOW* flow);
+void process_frame(AVFrame *pFrame, int frame_number, AVFrame *pFrameRGB, struct SwsContext **sws_ctx, AVFrame *pFrameDisplay, struct SwsContext **sws_ctx_display, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow);
+void seed_from_motion_vectors(AVFrame *pFrame, int analysis_width, int analysis_height, OPTICAL_FLOW* flow);
+int convert_frame(AVFrame *pFrame, AVFrame *pFrameRGB, struct SwsContext **sws_ctx, int sws_flags);
+AVFrame *alloc_rgb_frame(int width, int height, unsigned char** frame_buffer);
+int capture_interrupt_callback(void *opaque);
+void *capture_thread(void *vin);
+int mainloop_capture_thread(AVFormatContext *pFormatContext, AVCodecContext *pCodecContext, int video_stream_index, _Atomic int *capture_stop, struct timespec *ts_start,
+			    FRAME_SELECT* select, int max_frame_count, AVFrame *pFrameRGB, struct SwsContext **sws_ctx, AVFrame *pFrameDisplay, struct SwsContext **sws_ctx_display, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow);
+int decode_packet(AVPacket *pPacket, AVCodecContext *pCodecContext, FRAME_SELECT* select, AVFrame *pFrame,AVFrame *pFrameRGB, struct SwsContext **sws_ctx, AVFrame *pFrameDisplay, struct SwsContext **sws_ctx_display, int compare_with_first, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow);
 
 
 
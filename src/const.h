@@ -19,10 +19,20 @@
 #define OPTICAL_FLOW_BLOCK_SIZE 8
 #define OPTICAL_FLOW_MAX_SHIFT_GLOBAL 8    // shift_global === previoush shift
 #define OPTICAL_FLOW_MAX_SHIFT_LOCAL 4     // shift_local === distance from shift_global for search similar
+#define OPTICAL_FLOW_MAX_SHIFT_LOCAL_LIMIT 16 // if frames skipped: max_shift_local * frame_distance, but not more than limit
+#define OPTICAL_FLOW_SEED_RADIUS 2         // search distance around motion vector of codec
 #define OPTICAL_FLOW_MIN_NEIGHBOURS 3
 #define OPTICAL_FLOW_FPS 15
 #define OPTICAL_FLOW_LONG_TIME_WITHOUT_UPDATE 30
 #define OPTICAL_FLOW_PAINTED_BY_NEIGHBOR 40
+#define OPTICAL_FLOW_WARMUP_FRAMES 5       // segments of file processed in parallel: overlap for warm up of context
+#define OPTICAL_FLOW_EPZS_FACTOR 1.2       // predictive search stopped if cost < factor * min cost of neighbours + offset
+#define OPTICAL_FLOW_EPZS_OFFSET 0.5       // (mean absolute difference of pixels)
+#define OPTICAL_FLOW_GLOBAL_SAMPLES 128    // blocks of sparse grid for estimation of global motion (camera ego-motion)
+#define OPTICAL_FLOW_GLOBAL_MIN_SUPPORT 0.3 // fraction of samples with same shift (+-1 pixel) for global motion
+#define OPTICAL_FLOW_QUADTREE_SIZE 32      // root of adaptive partition (pixels), split down to OPTICAL_FLOW_BLOCK_SIZE
+#define OPTICAL_FLOW_QUADTREE_SPLIT_COST 8.0 // node split if cost of quadrant (mean absolute difference of pixels) higher
+#define OPTICAL_FLOW_QUADTREE_DISAGREEMENT 1 // or if previous shift of covered block differ more (pixels)
 
 
 
@@ -32,6 +42,29 @@
 #define OPTICAL_FLOW_UPDATED_IN_PREVIOUS_ITERATION 1
 
 
+#define JPEG_QUALITY 100
+#define JPEG_WRITER_THREADS 2              // 0 === save images synchronously
+#define JPEG_WRITER_QUEUE 8
+#define VIDEO_WRITER_QUEUE 8
+#define SHM_RING_NAME "/optical-flow"     // POSIX shared memory object: /dev/shm/optical-flow
+#define SHM_RING_SLOTS 4
+#define FLOW_STREAM_BUFFER 65536           // bytes, buffer of stdout stream (-o)
+#define MJPEG_FPS 5                        // preview rate, independent of processing
+#define MJPEG_QUALITY 70
+#define MJPEG_BACKLOG 8
+#define MJPEG_SOCKET_TIMEOUT 2             // seconds, slow client disconnected
+#define MJPEG_SNAPSHOT_TIMEOUT 2           // seconds, wait new frame for /frame.jpeg
+#define EVENT_PRE_ROLL 15                  // frames kept in memory before motion (event mode)
+#define EVENT_POST_ROLL 30                 // frames written after end of motion
+#define GUI_IDLE_TIMEOUT 0.1               // seconds, display thread check window without new frames
+
+
+#define V4L2_BUFFER_COUNT 4
+#define V4L2_TIMEOUT_SECONDS 2
+#define V4L2_DEFAULT_WIDTH 640
+#define V4L2_DEFAULT_HEIGHT 480
+
+
 #define NANOSECONDS_IN_SECOND 1000000000L
 #define SECONDS_IN_DEGREE 60.0
 
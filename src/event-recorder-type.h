@@ -0,0 +1,44 @@
+/** \file
+   event-recorder-type.h --- header for event-recorder.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef EVENT_RECORDER_TYPE_H
+#define EVENT_RECORDER_TYPE_H
+
+#include <stdint.h>
+
+#include "image-type.h"
+#include "block-matching-type.h"
+
+// frame waiting in pre-roll: written if event start soon, else dropped
+typedef struct event_frame {
+	int frame_count;
+	int64_t time;              // pts in microseconds (AV_NOPTS_VALUE === unknown)
+	struct imgRawImage* image; // drawn image (NULL === images and video not saved), owned by ring
+	BLK* array;                // copy of blocks (NULL === flow not saved, or not calculated for frame)
+	int frame_distance;
+} EVENT_FRAME;
+
+typedef struct event_recorder {
+	double threshold;          // fraction of moving blocks (0..1) for start of event
+	int post_roll;             // frames written after end of motion
+
+	EVENT_FRAME* pre_roll;     // ring buffer of last frames before event
+	int capacity;
+	int head;                  // oldest frame
+	int count;
+
+	int active;                // event in progress: frames written
+	int post_left;             // frames of post-roll left
+
+	unsigned long int events;
+	unsigned long int written; // frames
+	unsigned long int dropped;
+} EVENT_RECORDER;
+
+#endif /* EVENT_RECORDER_TYPE_H */
@@ -0,0 +1,194 @@
+/** \file
+event-recorder.c --- motion triggered recording: outputs written only during motion, with pre-roll and post-roll
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: optical flow event motion detection recording pre-roll post-roll
+
+Usage:
+    ./optical_flow -v 1 --event 0.02 --event-pre 15 --event-post 30 -d /dev/video0
+    ./optical_flow --video-out /tmp/events.mkv --flow-out /tmp/events.oflow --event 0.02 -d /dev/video0
+
+    for every processed frame (see process_image):
+    event_recorder_update() --- true: write frame (and frames of pre-roll taken by event_recorder_pop())
+                                false: keep frame in pre-roll by event_recorder_push()
+
+    event start:  fraction of moving blocks (FLOW_STATS) >= threshold
+                  (with --global-motion: blocks moving relative to camera motion)
+    event end:    post_roll frames without motion
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "const.h"
+#include "event-recorder.h"
+
+
+
+/**
+   \param threshold fraction of moving blocks (0..1)
+   \param pre_roll frames kept in memory before event
+   \param post_roll frames written after end of motion
+*/
+int init_event_recorder (EVENT_RECORDER* recorder, double threshold, int pre_roll, int post_roll)
+{
+	memset(recorder, 0, sizeof(EVENT_RECORDER));
+	recorder->threshold = threshold;
+	recorder->post_roll = (post_roll > 0) ? post_roll : 0;
+	recorder->capacity = (pre_roll > 0) ? pre_roll : 0;
+
+	if (recorder->capacity > 0) {
+		recorder->pre_roll = (EVENT_FRAME*) calloc(recorder->capacity, sizeof(EVENT_FRAME));
+		if (recorder->pre_roll == NULL) {
+			printf("ERROR could not allocate pre-roll: %d frames\n", pre_roll);
+			return -1;
+		}
+	}
+	printf("event mode: moving blocks >= %.1f%%, pre-roll %d frames, post-roll %d frames\n",
+	       threshold * 100.0, recorder->capacity, recorder->post_roll);
+	return 0;
+}
+
+
+
+static void free_event_frame (EVENT_FRAME* frame)
+{
+	if (frame->image != NULL) {
+		free(frame->image->lpData);
+		free(frame->image);
+	}
+	free(frame->array);
+	frame->image = NULL;
+	frame->array = NULL;
+}
+
+
+
+/**
+   Start, continue or end event by motion of frame
+
+   \param flow_valid false if optical flow not calculated for frame (first frame): no motion
+   \return true if frame must be written (event or post-roll), false if frame for pre-roll
+*/
+int event_recorder_update (EVENT_RECORDER* recorder, int frame_count, OPTICAL_FLOW* flow, int flow_valid)
+{
+	// camera in motion (global motion estimated): only motion of objects start event
+	unsigned long int moving_blocks = (flow->global_motion) ? flow->stats.local_moving : flow->stats.moving;
+	double moving = (flow_valid && flow->array_size > 0) ? (double)moving_blocks / flow->array_size : 0.0;
+
+	if (moving >= recorder->threshold && flow_valid) {
+		if (!recorder->active) {
+			recorder->active = true;
+			recorder->events++;
+			printf("event %lu start: frame %d moving %.1f%%\n", recorder->events, frame_count, moving * 100.0);
+		}
+		recorder->post_left = recorder->post_roll;
+	} else if (recorder->active) {
+		if (recorder->post_left > 0) {
+			recorder->post_left--;
+		} else {
+			recorder->active = false;
+			printf("event %lu end: frame %d\n", recorder->events, frame_count);
+		}
+	}
+
+	if (recorder->active) recorder->written++;
+	return recorder->active;
+}
+
+
+
+/**
+   Keep frame in pre-roll (oldest frame dropped if ring full)
+
+   \param time pts of frame in microseconds (AV_NOPTS_VALUE === unknown)
+   \param image owned by recorder
+   \param flow blocks copied (NULL === flow not saved)
+*/
+void event_recorder_push (EVENT_RECORDER* recorder, int frame_count, int64_t time, struct imgRawImage* image, OPTICAL_FLOW* flow)
+{
+	recorder->dropped++; // not written, if event not start soon
+	if (recorder->capacity == 0) {
+		EVENT_FRAME frame = {.image = image, .array = NULL};
+		free_event_frame(&frame);
+		return;
+	}
+
+	if (recorder->count == recorder->capacity) {
+		free_event_frame(&recorder->pre_roll[recorder->head]);
+		recorder->head = (recorder->head + 1) % recorder->capacity;
+		recorder->count--;
+	}
+
+	EVENT_FRAME* frame = &recorder->pre_roll[(recorder->head + recorder->count) % recorder->capacity];
+	frame->frame_count = frame_count;
+	frame->time = time;
+	frame->image = image;
+	frame->array = NULL;
+	frame->frame_distance = 1;
+	if (flow != NULL) {
+		frame->array = (BLK*) malloc(sizeof(BLK) * flow->array_size);
+		if (frame->array != NULL) memcpy(frame->array, flow->array, sizeof(BLK) * flow->array_size);
+		frame->frame_distance = flow->frame_distance;
+	}
+	recorder->count++;
+}
+
+
+
+/**
+   Take oldest frame of pre-roll (owned by caller: free image and array)
+
+   \return -1 if pre-roll empty
+*/
+int event_recorder_pop (EVENT_RECORDER* recorder, EVENT_FRAME* frame)
+{
+	if (recorder->count == 0) return -1;
+	*frame = recorder->pre_roll[recorder->head];
+	memset(&recorder->pre_roll[recorder->head], 0, sizeof(EVENT_FRAME));
+	recorder->head = (recorder->head + 1) % recorder->capacity;
+	recorder->count--;
+	recorder->dropped--;
+	recorder->written++;
+	return 0;
+}
+
+
+
+void close_event_recorder (EVENT_RECORDER* recorder)
+{
+	while (recorder->count > 0) {
+		free_event_frame(&recorder->pre_roll[recorder->head]);
+		recorder->head = (recorder->head + 1) % recorder->capacity;
+		recorder->count--;
+	}
+	free(recorder->pre_roll);
+	printf("event mode: %lu events, %lu frames written, %lu frames skipped\n",
+	       recorder->events, recorder->written, recorder->dropped);
+}
@@ -0,0 +1,21 @@
+/** \file
+   event-recorder.h --- header for event-recorder.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef EVENT_RECORDER_H
+#define EVENT_RECORDER_H
+
+#include "event-recorder-type.h"
+
+int init_event_recorder (EVENT_RECORDER* recorder, double threshold, int pre_roll, int post_roll);
+int event_recorder_update (EVENT_RECORDER* recorder, int frame_count, OPTICAL_FLOW* flow, int flow_valid);
+void event_recorder_push (EVENT_RECORDER* recorder, int frame_count, int64_t time, struct imgRawImage* image, OPTICAL_FLOW* flow);
+int event_recorder_pop (EVENT_RECORDER* recorder, EVENT_FRAME* frame);
+void close_event_recorder (EVENT_RECORDER* recorder);
+
+#endif /* EVENT_RECORDER_H */
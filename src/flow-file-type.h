@@ -0,0 +1,101 @@
+/** \file
+   flow-file-type.h --- header for flow-file.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+   Binary optical flow file (native byte order, little-endian on x86/ARM):
+
+   FLOW_FILE_HEADER
+   frame record 0: FLOW_FRAME_HEADER, planes (grid_width * grid_height values, row by row):
+                   cost    uint16 (if FLOW_FILE_COST):  mean absolute difference of pixels * 256
+                   shift_x int8 or int16 (FLOW_FILE_INT16)
+                   shift_y int8 or int16
+                   age     uint8  (if FLOW_FILE_AGE):   frames since last update of block (saturated)
+                   padding up to frame_size (multiple of 8 bytes)
+   frame record 1
+   ...
+   index:   uint64 offset of every frame record
+   FLOW_FILE_TRAILER
+
+   All frame records have same size (frame_size): if file not closed
+   (no trailer), frame i at sizeof(FLOW_FILE_HEADER) + i * frame_size.
+
+   Grid is bottom-up (FLOW_FILE_BOTTOM_UP): row 0 is bottom of image,
+   positive shift_y is move up (OpenGL orientation, see frame_to_image).
+   Shift in pixels of analysis image: multiply by analysis_scale for pixels of source.
+   Block (i, j) cover pixels [i * block_size, (i + 1) * block_size) of analysis image.
+*/
+
+// include guard
+#ifndef FLOW_FILE_TYPE_H
+#define FLOW_FILE_TYPE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define FLOW_FILE_MAGIC "OFLOW\0\0\1"
+#define FLOW_FILE_INDEX_MAGIC "OFINDEX1"
+#define FLOW_FILE_MAGIC_LEN 8
+#define FLOW_FILE_VERSION 1
+
+enum flow_file_flags {
+	FLOW_FILE_INT16     = 0x01, // shift planes int16 (else int8, saturated)
+	FLOW_FILE_COST      = 0x02,
+	FLOW_FILE_AGE       = 0x04,
+	FLOW_FILE_BOTTOM_UP = 0x08
+};
+
+enum flow_file_plane {FLOW_PLANE_COST, FLOW_PLANE_SHIFT_X, FLOW_PLANE_SHIFT_Y, FLOW_PLANE_AGE, FLOW_PLANE_END}; // FLOW_PLANE_END === size of record
+
+typedef struct flow_file_header {
+	char magic[FLOW_FILE_MAGIC_LEN];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t grid_width;     // blocks
+	uint32_t grid_height;
+	uint32_t block_size;     // pixels of analysis image
+	uint32_t analysis_scale;
+	uint32_t image_width;    // analysis image
+	uint32_t image_height;
+	uint32_t frame_size;     // bytes of frame record (with FLOW_FRAME_HEADER)
+	uint32_t reserved;
+} FLOW_FILE_HEADER;
+
+typedef struct flow_frame_header {
+	int64_t frame_number;    // number of frame in source
+	uint32_t frame_distance; // to previous processed frame (in frames of source)
+	uint32_t reserved;
+} FLOW_FRAME_HEADER;
+
+typedef struct flow_file_trailer {
+	char magic[FLOW_FILE_MAGIC_LEN];
+	uint64_t index_offset;
+	uint64_t frame_count;
+} FLOW_FILE_TRAILER;
+
+// writer
+typedef struct flow_file {
+	FILE *fp;
+	char *file_name;
+	uint32_t flags;
+	int header_written;     // header written by first frame: size of grid unknown before
+	FLOW_FILE_HEADER header;
+	unsigned char *record;  // buffer of one frame record
+	uint64_t *index;
+	uint64_t frame_count;
+	uint64_t index_capacity;
+} FLOW_FILE;
+
+// reader (memory mapped file)
+typedef struct flow_file_map {
+	unsigned char *map;
+	size_t map_size;
+	FLOW_FILE_HEADER* header;
+	uint64_t *index;        // NULL if file not closed: fixed size records used
+	uint64_t frame_count;
+} FLOW_FILE_MAP;
+
+#endif /* FLOW_FILE_TYPE_H */
@@ -0,0 +1,303 @@
+/** \file
+flow-file.c --- compact binary file of optical flow (shift of blocks) with index of frames
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: optical flow binary file index mmap
+
+Usage:
+    ./optical_flow --flow-out /tmp/record.oflow --flow-cost --flow-age -d record.mp4
+
+    writer: init_flow_file(), write_flow_frame() for every frame, close_flow_file() write index
+    reader: map_flow_file(), get_flow_frame(), get_flow_plane(), unmap_flow_file()
+
+    Layout of file see in flow-file-type.h
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "const.h"
+#include "flow-file.h"
+#include "util.h"
+
+#define FLOW_FILE_INDEX_CAPACITY 1024
+
+
+
+/**
+   Offset of plane from start of frame record
+
+   \return -1 if plane not stored in file
+*/
+long int get_flow_plane_offset (FLOW_FILE_HEADER* header, uint32_t plane)
+{
+	long int plane_len = (long int)header->grid_width * header->grid_height;
+	int shift_bytes = (header->flags & FLOW_FILE_INT16) ? sizeof(int16_t) : sizeof(int8_t);
+
+	// planes ordered by alignment: uint16, int16 (or int8), uint8
+	long int offset = sizeof(FLOW_FRAME_HEADER);
+	long int cost = (header->flags & FLOW_FILE_COST) ? offset : -1;
+	if (header->flags & FLOW_FILE_COST) offset += plane_len * sizeof(uint16_t);
+	long int shift_x = offset;
+	offset += plane_len * shift_bytes;
+	long int shift_y = offset;
+	offset += plane_len * shift_bytes;
+	long int age = (header->flags & FLOW_FILE_AGE) ? offset : -1;
+	if (header->flags & FLOW_FILE_AGE) offset += plane_len * sizeof(uint8_t);
+
+	switch (plane) {
+	case FLOW_PLANE_COST:    return cost;
+	case FLOW_PLANE_SHIFT_X: return shift_x;
+	case FLOW_PLANE_SHIFT_Y: return shift_y;
+	case FLOW_PLANE_AGE:     return age;
+	default:                 return (offset + 7) & ~7L; // FLOW_PLANE_END: size of record, multiple of 8 bytes
+	}
+}
+
+
+
+/**
+   \param flags FLOW_FILE_INT16, FLOW_FILE_COST, FLOW_FILE_AGE
+*/
+int init_flow_file (FLOW_FILE* file, char *file_name, uint32_t flags)
+{
+	memset(file, 0, sizeof(FLOW_FILE));
+	file->file_name = file_name;
+	file->flags = flags | FLOW_FILE_BOTTOM_UP;
+
+	file->fp = fopen(file_name, "wb");
+	if (file->fp == NULL) {
+		printf("ERROR could not open flow file: %s\n", file_name);
+		return -1;
+	}
+
+	file->index_capacity = FLOW_FILE_INDEX_CAPACITY;
+	file->index = (uint64_t*) malloc(sizeof(uint64_t) * file->index_capacity);
+	if (file->index == NULL) {
+		fclose(file->fp);
+		return -1;
+	}
+	return 0;
+}
+
+
+
+static int write_flow_header (FLOW_FILE* file, OPTICAL_FLOW* flow)
+{
+	FLOW_FILE_HEADER* header = &file->header;
+
+	memcpy(header->magic, FLOW_FILE_MAGIC, FLOW_FILE_MAGIC_LEN);
+	header->version = FLOW_FILE_VERSION;
+	header->flags = file->flags;
+	header->grid_width = flow->width;
+	header->grid_height = flow->height;
+	header->block_size = flow->block_size_in_pixel;
+	header->analysis_scale = flow->analysis_scale;
+	header->image_width = (flow->raw_image != NULL) ? flow->raw_image->width : flow->width * flow->block_size_in_pixel;
+	header->image_height = (flow->raw_image != NULL) ? flow->raw_image->height : flow->height * flow->block_size_in_pixel;
+	header->frame_size = get_flow_plane_offset(header, FLOW_PLANE_END);
+	header->reserved = 0;
+
+	file->record = (unsigned char*) calloc(header->frame_size, 1);
+	if (file->record == NULL) return -1;
+
+	if (fwrite(header, sizeof(FLOW_FILE_HEADER), 1, file->fp) != 1) return -1;
+	file->header_written = true;
+	return 0;
+}
+
+
+
+static long int saturate (long int value, long int min, long int max)
+{
+	return MIN(MAX(value, min), max);
+}
+
+
+
+int write_flow_frame (FLOW_FILE* file, int64_t frame_number, OPTICAL_FLOW* flow)
+{
+	if (!file->header_written && write_flow_header(file, flow) != 0) {
+		printf("ERROR could not write flow file header: %s\n", file->file_name);
+		return -1;
+	}
+	FLOW_FILE_HEADER* header = &file->header;
+	if (flow->array_size != (unsigned long int)header->grid_width * header->grid_height) return -1;
+
+	FLOW_FRAME_HEADER* frame = (FLOW_FRAME_HEADER*) file->record;
+	frame->frame_number = frame_number;
+	frame->frame_distance = flow->frame_distance;
+	frame->reserved = 0;
+
+	long int cost = get_flow_plane_offset(header, FLOW_PLANE_COST);
+	long int shift_x = get_flow_plane_offset(header, FLOW_PLANE_SHIFT_X);
+	long int shift_y = get_flow_plane_offset(header, FLOW_PLANE_SHIFT_Y);
+	long int age = get_flow_plane_offset(header, FLOW_PLANE_AGE);
+
+	for (unsigned long int i = 0; i < flow->array_size; i++) {
+		BLK* blk = &flow->array[i];
+		if (header->flags & FLOW_FILE_INT16) {
+			((int16_t*)(file->record + shift_x))[i] = saturate(blk->shift.x, INT16_MIN, INT16_MAX);
+			((int16_t*)(file->record + shift_y))[i] = saturate(blk->shift.y, INT16_MIN, INT16_MAX);
+		} else {
+			((int8_t*)(file->record + shift_x))[i] = saturate(blk->shift.x, INT8_MIN, INT8_MAX);
+			((int8_t*)(file->record + shift_y))[i] = saturate(blk->shift.y, INT8_MIN, INT8_MAX);
+		}
+		if (cost >= 0) ((uint16_t*)(file->record + cost))[i] = saturate(lround(blk->diff * 256.0), 0, UINT16_MAX);
+		if (age >= 0) ((uint8_t*)(file->record + age))[i] = saturate(blk->last_update, 0, UINT8_MAX);
+	}
+
+	if (file->frame_count == file->index_capacity) {
+		uint64_t *index = (uint64_t*) realloc(file->index, sizeof(uint64_t) * file->index_capacity * 2);
+		if (index == NULL) return -1;
+		file->index = index;
+		file->index_capacity *= 2;
+	}
+	file->index[file->frame_count] = sizeof(FLOW_FILE_HEADER) + file->frame_count * header->frame_size;
+
+	if (fwrite(file->record, header->frame_size, 1, file->fp) != 1) {
+		printf("ERROR could not write flow file: %s\n", file->file_name);
+		return -1;
+	}
+	file->frame_count++;
+	return 0;
+}
+
+
+
+/**
+   Write index and trailer
+*/
+int close_flow_file (FLOW_FILE* file)
+{
+	int result = 0;
+
+	if (file->header_written) {
+		FLOW_FILE_TRAILER trailer;
+		memcpy(trailer.magic, FLOW_FILE_INDEX_MAGIC, FLOW_FILE_MAGIC_LEN);
+		trailer.index_offset = sizeof(FLOW_FILE_HEADER) + file->frame_count * file->header.frame_size;
+		trailer.frame_count = file->frame_count;
+		if (fwrite(file->index, sizeof(uint64_t), file->frame_count, file->fp) != file->frame_count ||
+		    fwrite(&trailer, sizeof(FLOW_FILE_TRAILER), 1, file->fp) != 1) {
+			result = -1;
+		}
+	}
+	if (fclose(file->fp) != 0) result = -1;
+	printf("flow file: %s %lu frames%s\n", file->file_name, (unsigned long int)file->frame_count, (result != 0) ? " (write error)" : "");
+
+	free(file->index);
+	free(file->record);
+	return result;
+}
+
+
+
+int map_flow_file (char *file_name, FLOW_FILE_MAP* file_map)
+{
+	memset(file_map, 0, sizeof(FLOW_FILE_MAP));
+
+	int fd = open(file_name, O_RDONLY);
+	if (fd < 0) {
+		printf("ERROR could not open flow file: %s\n", file_name);
+		return -1;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(FLOW_FILE_HEADER)) {
+		printf("ERROR not flow file: %s\n", file_name);
+		close(fd);
+		return -1;
+	}
+	file_map->map_size = file_stat.st_size;
+	file_map->map = mmap(NULL, file_map->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (file_map->map == MAP_FAILED) {
+		file_map->map = NULL;
+		return -1;
+	}
+
+	file_map->header = (FLOW_FILE_HEADER*) file_map->map;
+	if (memcmp(file_map->header->magic, FLOW_FILE_MAGIC, FLOW_FILE_MAGIC_LEN) != 0 ||
+	    file_map->header->version != FLOW_FILE_VERSION ||
+	    file_map->header->frame_size < sizeof(FLOW_FRAME_HEADER)) {
+		printf("ERROR not flow file (or unknown version): %s\n", file_name);
+		unmap_flow_file(file_map);
+		return -1;
+	}
+
+	// frames counted by fixed size records if file not closed
+	file_map->frame_count = (file_map->map_size - sizeof(FLOW_FILE_HEADER)) / file_map->header->frame_size;
+	if (file_map->map_size >= sizeof(FLOW_FILE_HEADER) + sizeof(FLOW_FILE_TRAILER)) {
+		FLOW_FILE_TRAILER* trailer = (FLOW_FILE_TRAILER*) (file_map->map + file_map->map_size - sizeof(FLOW_FILE_TRAILER));
+		if (memcmp(trailer->magic, FLOW_FILE_INDEX_MAGIC, FLOW_FILE_MAGIC_LEN) == 0 &&
+		    trailer->index_offset + trailer->frame_count * sizeof(uint64_t) + sizeof(FLOW_FILE_TRAILER) == file_map->map_size) {
+			file_map->index = (uint64_t*) (file_map->map + trailer->index_offset);
+			file_map->frame_count = trailer->frame_count;
+		}
+	}
+	return 0;
+}
+
+
+
+/**
+   \return NULL if no such frame
+*/
+FLOW_FRAME_HEADER* get_flow_frame (FLOW_FILE_MAP* file_map, uint64_t frame)
+{
+	if (frame >= file_map->frame_count) return NULL;
+	uint64_t offset = (file_map->index != NULL) ? file_map->index[frame] :
+		sizeof(FLOW_FILE_HEADER) + frame * file_map->header->frame_size;
+	if (offset + file_map->header->frame_size > file_map->map_size) return NULL;
+	return (FLOW_FRAME_HEADER*) (file_map->map + offset);
+}
+
+
+
+/**
+   \return NULL if plane not stored in file
+*/
+void *get_flow_plane (FLOW_FILE_MAP* file_map, FLOW_FRAME_HEADER* frame, uint32_t plane)
+{
+	long int offset = get_flow_plane_offset(file_map->header, plane);
+	if (offset < 0) return NULL;
+	return (unsigned char*)frame + offset;
+}
+
+
+
+void unmap_flow_file (FLOW_FILE_MAP* file_map)
+{
+	if (file_map->map != NULL) munmap(file_map->map, file_map->map_size);
+	file_map->map = NULL;
+}
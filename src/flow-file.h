@@ -0,0 +1,27 @@
+/** \file
+   flow-file.h --- header for flow-file.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef FLOW_FILE_H
+#define FLOW_FILE_H
+
+#include "flow-file-type.h"
+#include "image-type.h"
+#include "block-matching-type.h"
+
+long int get_flow_plane_offset (FLOW_FILE_HEADER* header, uint32_t plane);
+int init_flow_file (FLOW_FILE* file, char *file_name, uint32_t flags);
+int write_flow_frame (FLOW_FILE* file, int64_t frame_number, OPTICAL_FLOW* flow);
+int close_flow_file (FLOW_FILE* file);
+
+int map_flow_file (char *file_name, FLOW_FILE_MAP* file_map);
+FLOW_FRAME_HEADER* get_flow_frame (FLOW_FILE_MAP* file_map, uint64_t frame);
+void *get_flow_plane (FLOW_FILE_MAP* file_map, FLOW_FRAME_HEADER* frame, uint32_t plane);
+void unmap_flow_file (FLOW_FILE_MAP* file_map);
+
+#endif /* FLOW_FILE_H */
@@ -0,0 +1,89 @@
+/** \file
+   flow-stream-type.h --- header for flow-stream.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+   Stream of length-prefixed records (native byte order, little-endian on x86/ARM), one per frame:
+
+   uint32_t length              bytes after this field (FLOW_STREAM_RECORD and payload)
+   FLOW_STREAM_RECORD
+   payload, count items:
+       FLOW_STREAM_DENSE:  FLOW_STREAM_SHIFT  for every block (grid_width * grid_height, row by row)
+       FLOW_STREAM_SPARSE: FLOW_STREAM_MOVING for blocks with non-zero shift only
+       FLOW_STREAM_STATS:  one FLOW_STREAM_SUMMARY (summary of frame, 64 bytes)
+
+   Consumer read length, then read length bytes (unknown record mode or
+   version can be skipped by length). Grid bottom-up (row 0 is bottom of
+   image, positive shift_y is move up), shift in pixels of analysis image
+   (multiply by analysis_scale), as in flow-file-type.h.
+*/
+
+// include guard
+#ifndef FLOW_STREAM_TYPE_H
+#define FLOW_STREAM_TYPE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define FLOW_STREAM_MAGIC "OFST"
+#define FLOW_STREAM_MAGIC_LEN 4
+#define FLOW_STREAM_VERSION 1
+#define FLOW_STREAM_NO_PTS INT64_MIN
+
+enum flow_stream_mode {FLOW_STREAM_DENSE, FLOW_STREAM_SPARSE, FLOW_STREAM_STATS};
+
+typedef struct flow_stream_record {
+	char magic[FLOW_STREAM_MAGIC_LEN];
+	uint16_t version;
+	uint16_t mode;           // FLOW_STREAM_DENSE, FLOW_STREAM_SPARSE or FLOW_STREAM_STATS
+	int64_t frame_number;    // number of frame in source
+	int64_t pts;             // microseconds, FLOW_STREAM_NO_PTS === unknown (raw input)
+	uint32_t frame_distance; // to previous processed frame (in frames of source)
+	uint16_t grid_width;     // blocks
+	uint16_t grid_height;
+	uint16_t block_size;     // pixels of analysis image
+	uint16_t analysis_scale;
+	uint32_t count;          // items in payload
+} FLOW_STREAM_RECORD;
+
+typedef struct flow_stream_shift {
+	int16_t shift_x;
+	int16_t shift_y;
+} FLOW_STREAM_SHIFT;
+
+typedef struct flow_stream_moving {
+	uint16_t x;              // block
+	uint16_t y;
+	int16_t shift_x;
+	int16_t shift_y;
+} FLOW_STREAM_MOVING;
+
+// see FLOW_STATS in block-matching-type.h
+typedef struct flow_stream_summary {
+	uint32_t moving;             // blocks with non-zero shift
+	uint32_t stale;              // blocks not measured long time
+	float mean_x;                // mean shift of moving blocks
+	float mean_y;
+	float mean_age;              // frames since update, mean of all blocks
+	uint32_t magnitude_histogram[8]; // |shift|: [0..1], (1..2], (2..4], ... (32..64], > 64
+	uint16_t bbox_x0;            // bounding box of moving blocks (inclusive), valid if moving > 0
+	uint16_t bbox_y0;
+	uint16_t bbox_x1;
+	uint16_t bbox_y1;
+	int16_t dominant_direction;  // sector of 45 degrees: 0 === right, 2 === up, 4 === left, 6 === down; -1 === no motion
+	uint16_t reserved;
+} FLOW_STREAM_SUMMARY;
+
+typedef struct flow_stream {
+	FILE *fp;
+	int mode;
+	int broken;              // reader closed pipe: output stopped
+	unsigned char *record;   // length, FLOW_STREAM_RECORD and payload of one frame
+	size_t record_capacity;
+	uint64_t frame_count;
+} FLOW_STREAM;
+
+#endif /* FLOW_STREAM_TYPE_H */
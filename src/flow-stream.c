@@ -0,0 +1,181 @@
+/** \file
+flow-stream.c --- stream of per-frame optical flow records to stdout (pipe)
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: optical flow stdout pipe stream length-prefixed record
+
+Usage:
+    ./optical_flow -o -d record.mp4 | consumer
+    ./optical_flow --output-sparse -d /dev/video0 | consumer
+    ./optical_flow --output-stats -d /dev/video0 | consumer
+
+    diagnostic messages moved to stderr (see main.c), stdout used by records only
+
+    Layout of record see in flow-stream-type.h
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "const.h"
+#include "flow-stream.h"
+#include "util.h"
+
+
+
+static long int saturate (long int value, long int min, long int max)
+{
+	return MIN(MAX(value, min), max);
+}
+
+
+
+/**
+   \param fd file descriptor of output (duplicated stdout), owned by stream
+   \param mode FLOW_STREAM_DENSE, FLOW_STREAM_SPARSE or FLOW_STREAM_STATS
+*/
+int init_flow_stream (FLOW_STREAM* stream, int fd, int mode)
+{
+	memset(stream, 0, sizeof(FLOW_STREAM));
+	stream->mode = mode;
+
+	stream->fp = fdopen(fd, "wb");
+	if (stream->fp == NULL) {
+		fprintf(stderr, "ERROR could not open output stream\n");
+		return -1;
+	}
+	// record written by one fwrite, flushed by one write() per frame
+	setvbuf(stream->fp, NULL, _IOFBF, FLOW_STREAM_BUFFER);
+	return 0;
+}
+
+
+
+/**
+   Blocking write: slow reader of pipe slow down processing (backpressure)
+
+   \param pts microseconds, FLOW_STREAM_NO_PTS === unknown
+*/
+int write_flow_stream (FLOW_STREAM* stream, int64_t frame_number, int64_t pts, OPTICAL_FLOW* flow)
+{
+	if (stream->broken) return -1;
+
+	size_t item_size = (stream->mode == FLOW_STREAM_SPARSE) ? sizeof(FLOW_STREAM_MOVING) : sizeof(FLOW_STREAM_SHIFT);
+	size_t capacity = sizeof(uint32_t) + sizeof(FLOW_STREAM_RECORD) + flow->array_size * item_size;
+	if (stream->mode == FLOW_STREAM_STATS) {
+		item_size = sizeof(FLOW_STREAM_SUMMARY);
+		capacity = sizeof(uint32_t) + sizeof(FLOW_STREAM_RECORD) + item_size;
+	}
+	if (capacity > stream->record_capacity) {
+		unsigned char *record = (unsigned char*) realloc(stream->record, capacity);
+		if (record == NULL) return -1;
+		stream->record = record;
+		stream->record_capacity = capacity;
+	}
+
+	// header copied after length: int64 fields not aligned there (armv7)
+	FLOW_STREAM_RECORD header;
+	unsigned char *payload = stream->record + sizeof(uint32_t) + sizeof(FLOW_STREAM_RECORD);
+	memcpy(header.magic, FLOW_STREAM_MAGIC, FLOW_STREAM_MAGIC_LEN);
+	header.version = FLOW_STREAM_VERSION;
+	header.mode = stream->mode;
+	header.frame_number = frame_number;
+	header.pts = pts;
+	header.frame_distance = flow->frame_distance;
+	header.grid_width = flow->width;
+	header.grid_height = flow->height;
+	header.block_size = flow->block_size_in_pixel;
+	header.analysis_scale = flow->analysis_scale;
+
+	uint32_t count = 0;
+	if (stream->mode == FLOW_STREAM_STATS) {
+		// computed by block_matching_optimized_images: bytes instead of grid
+		FLOW_STATS* stats = &flow->stats;
+		FLOW_STREAM_SUMMARY record;
+		memset(&record, 0, sizeof(FLOW_STREAM_SUMMARY));
+		record.moving = stats->moving;
+		record.stale = stats->stale;
+		record.mean_x = stats->mean_x;
+		record.mean_y = stats->mean_y;
+		record.mean_age = stats->mean_age;
+		for (int i = 0; i < FLOW_STATS_BINS; i++) record.magnitude_histogram[i] = stats->magnitude_histogram[i];
+		record.bbox_x0 = stats->bbox_min.x;
+		record.bbox_y0 = stats->bbox_min.y;
+		record.bbox_x1 = stats->bbox_max.x;
+		record.bbox_y1 = stats->bbox_max.y;
+		record.dominant_direction = stats->dominant_direction;
+		memcpy(payload, &record, sizeof(FLOW_STREAM_SUMMARY));
+		count = 1;
+	} else if (stream->mode == FLOW_STREAM_SPARSE) {
+		FLOW_STREAM_MOVING* moving = (FLOW_STREAM_MOVING*) payload;
+		for (unsigned long int j = 0; j < flow->height; j++) {
+			for (unsigned long int i = 0; i < flow->width; i++) {
+				BLK* blk = &flow->array[j * flow->width + i];
+				if (blk->shift.x == 0 && blk->shift.y == 0) continue;
+				moving[count].x = i;
+				moving[count].y = j;
+				moving[count].shift_x = saturate(blk->shift.x, INT16_MIN, INT16_MAX);
+				moving[count].shift_y = saturate(blk->shift.y, INT16_MIN, INT16_MAX);
+				count++;
+			}
+		}
+	} else {
+		FLOW_STREAM_SHIFT* shift = (FLOW_STREAM_SHIFT*) payload;
+		for (unsigned long int i = 0; i < flow->array_size; i++) {
+			shift[i].shift_x = saturate(flow->array[i].shift.x, INT16_MIN, INT16_MAX);
+			shift[i].shift_y = saturate(flow->array[i].shift.y, INT16_MIN, INT16_MAX);
+		}
+		count = flow->array_size;
+	}
+	header.count = count;
+
+	uint32_t length = sizeof(FLOW_STREAM_RECORD) + count * item_size;
+	memcpy(stream->record, &length, sizeof(uint32_t));
+	memcpy(stream->record + sizeof(uint32_t), &header, sizeof(FLOW_STREAM_RECORD));
+
+	if (fwrite(stream->record, sizeof(uint32_t) + length, 1, stream->fp) != 1 ||
+	    fflush(stream->fp) != 0) {
+		// EPIPE: reader closed pipe (SIGPIPE ignored in main.c)
+		fprintf(stderr, "output stream stopped after %lu frames: %s\n", (unsigned long int)stream->frame_count, strerror(errno));
+		stream->broken = true;
+		return -1;
+	}
+	stream->frame_count++;
+	return 0;
+}
+
+
+
+void close_flow_stream (FLOW_STREAM* stream)
+{
+	fprintf(stderr, "output stream: %lu frames\n", (unsigned long int)stream->frame_count);
+	fclose(stream->fp);
+	free(stream->record);
+}
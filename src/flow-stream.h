@@ -0,0 +1,21 @@
+/** \file
+   flow-stream.h --- header for flow-stream.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef FLOW_STREAM_H
+#define FLOW_STREAM_H
+
+#include "flow-stream-type.h"
+#include "image-type.h"
+#include "block-matching-type.h"
+
+int init_flow_stream (FLOW_STREAM* stream, int fd, int mode);
+int write_flow_stream (FLOW_STREAM* stream, int64_t frame_number, int64_t pts, OPTICAL_FLOW* flow);
+void close_flow_stream (FLOW_STREAM* stream);
+
+#endif /* FLOW_STREAM_H */
@@ -0,0 +1,58 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 ourColor;
+in vec2 TexCoord;
+
+// colorize frame by optical flow (same as colorize() in block-matching.c):
+// hue === direction of shift, saturation === length of shift, lightness === luma
+
+uniform sampler2D lumaTexture;   // luma of frame (red channel)
+uniform isampler2D shiftTexture; // shift of every block in pixels: grid of blocks, bottom-up as frame
+uniform vec2 imageSize;          // pixels
+uniform float blockSize;         // pixels of frame
+uniform float maxShift;          // length of shift for full saturation
+uniform int hideStaticBlock;     // static blocks faded
+
+const float PI = 3.14159265358979;
+
+vec3 shift_to_color(float lightness, vec2 shift)
+{
+	float angle = atan(shift.y, shift.x);
+	if (angle < 0.0) angle += 2.0 * PI;
+	float h = degrees(angle) / 60.0;
+	float saturation = length(shift) / maxShift;
+
+	float c = (1.0 - abs(2.0 * lightness - 1.0)) * saturation; // chroma
+	float x = c * (1.0 - abs(mod(h, 2.0) - 1.0));
+	float m = lightness - c / 2.0;
+
+	vec3 rgb = vec3(c, 0.0, x); // 5.0 <= h
+	if (h < 1.0) rgb = vec3(c, x, 0.0);
+	else if (h < 2.0) rgb = vec3(x, c, 0.0);
+	else if (h < 3.0) rgb = vec3(0.0, c, x);
+	else if (h < 4.0) rgb = vec3(0.0, x, c);
+	else if (h < 5.0) rgb = vec3(x, 0.0, c);
+	return rgb + m;
+}
+
+void main()
+{
+	float mono = texture(lumaTexture, TexCoord).r;
+	ivec2 block = ivec2(floor(TexCoord * imageSize / blockSize));
+	ivec2 grid = textureSize(shiftTexture, 0);
+
+	vec2 shift = vec2(0.0);
+	if (block.x < grid.x && block.y < grid.y) {
+		shift = vec2(texelFetch(shiftTexture, block, 0).xy);
+	}
+
+	if (shift.x == 0.0 && shift.y == 0.0) {
+		if (hideStaticBlock != 0) {
+			mono = mono / 4.0 + 0.75;
+		}
+		FragColor = vec4(mono, mono, mono, 1.0);
+	} else {
+		FragColor = vec4(shift_to_color(mono, shift), 1.0);
+	}
+}
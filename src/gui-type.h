@@ -10,9 +10,53 @@
 #ifndef GUI_TYPE_H
 #define GUI_TYPE_H
 
+#include <pthread.h>
+#include <stdint.h>
+
+#include "image-type.h"
+
 typedef struct coord_2Df {
 	double x;
 	double y;
 } COORD_2DF;
 
+// streaming of frames into video texture by pixel buffer objects (see render_loop)
+typedef struct video_upload {
+	unsigned int pbo[2];     // written by CPU in turn: next frame not wait transfer of previous
+	int index;               // pbo for next frame
+	unsigned long int width; // size of texture storage (0 === not allocated)
+	unsigned long int height;
+	unsigned int components; // 1 === luma (colorized by flow.frag), 3 === drawn RGB image
+	size_t size;             // bytes of frame
+	unsigned int shift_texture; // shift of blocks (flow.frag)
+	int grid_width;          // size of shift texture storage
+	int grid_height;
+	unsigned int arrow_instances; // buffer of moving blocks (instanced arrows)
+} VIDEO_UPLOAD;
+
+// frame for display: drawn image, or luma and shift of blocks (colorized by flow.frag, without CPU colorize())
+typedef struct gui_frame {
+	struct imgRawImage* image; // RGB (drawn) or luma
+	int16_t* shift;            // x, y of every block, bottom-up (NULL === image drawn)
+	size_t shift_capacity;     // blocks
+	int grid_width;            // blocks
+	int grid_height;
+	float block_size;          // pixels of image
+	float max_shift;           // length of shift for full saturation
+	float shift_scale;         // pixels of analysis image to pixels of image
+	int16_t* arrows;           // moving blocks only: x, y of block, x, y of shift
+	size_t arrows_capacity;    // blocks
+	int arrow_count;           // 0 === without arrows
+} GUI_FRAME;
+
+// frames passed from processing thread to display (main) thread, which own OpenGL context
+typedef struct gui_display {
+	pthread_mutex_t mutex;
+	pthread_cond_t step_cond;
+	GUI_FRAME* pending;          // latest published frame, not displayed yet (older frame replaced)
+	GUI_FRAME* spare;            // displayed frame: buffers reused by next publish
+	int step;                    // step-by-step: next step allowed (space pressed)
+	int finished;                // processing ended: display loop stop
+} GUI_DISPLAY;
+
 #endif /* GUI_TYPE_H */
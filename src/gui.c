@@ -36,14 +36,45 @@ Code:
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <stdatomic.h>
 
 #include "gui-type.h"
 #include "gui.h"
 #include "const.h"
 #include "util.h"
 
-int space_step = false;
+static int uniform_video_texture = -1; // location of sampler in video shader program
+static struct {int image_size, block_size, max_shift, hide_static_block;} uniform_flow; // locations in flow shader program
+static struct {int image_size, block_size, shift_scale;} uniform_arrow; // locations in arrow shader program
+static _Atomic int show_arrows = false; // overlay of arrows (key 'a')
+static VIDEO_UPLOAD video_upload = {.pbo = {0, 0}, .index = 0, .width = 0, .height = 0, .components = 0, .size = 0,
+				    .shift_texture = 0, .grid_width = 0, .grid_height = 0};
+static GUI_DISPLAY gui_display = {.mutex = PTHREAD_MUTEX_INITIALIZER, .step_cond = PTHREAD_COND_INITIALIZER,
+					  .pending = NULL, .spare = NULL, .step = false, .finished = false};
+
+
+
+static void free_image (struct imgRawImage* image)
+{
+	if (image != NULL) {
+		free(image->lpData);
+		free(image);
+	}
+}
+
+
+
+static void free_frame (GUI_FRAME* frame)
+{
+	if (frame != NULL) {
+		free_image(frame->image);
+		free(frame->shift);
+		free(frame->arrows);
+		free(frame);
+	}
+}
 
 
 
@@ -73,6 +104,7 @@ int init_gui (unsigned int window_width, unsigned int window_height)
 
 	/* Make the window's context current */
 	glfwMakeContextCurrent(window);
+	glfwSwapInterval(1); // display rate: swap wait vertical sync (display thread only, processing not throttled)
 
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
@@ -83,6 +115,120 @@ int init_gui (unsigned int window_width, unsigned int window_height)
 }
 
 
+/**
+   Compile vertex and fragment shaders and link them into program
+   (once at init, only bound per frame)
+
+   \return program, 0 if failed
+*/
+static unsigned int build_shader_program (const char *vertexShaderSource, const char *fragmentShaderSource, const char *name)
+{
+	int success;
+	char infoLog[512];
+
+	// vertex shader
+	unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+	glCompileShader(vertexShader);
+	// check for shader compile errors
+	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+	if(!success) {
+		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+		printf ("ERROR::SHADER::VERTEX:%s:COMPILATION_FAILED\n%s\n", name, infoLog);
+	}
+
+	// fragment shader
+	unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+	glCompileShader(fragmentShader);
+	// check if compilation was successful
+	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+	if(!success) {
+		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+		printf ("ERROR::SHADER::FRAGMENT:%s:COMPILATION_FAILED\n%s\n", name, infoLog);
+	}
+
+	// link shaders
+	unsigned int shaderProgram = glCreateProgram();
+	glAttachShader(shaderProgram, vertexShader);
+	glAttachShader(shaderProgram, fragmentShader);
+	glLinkProgram(shaderProgram);
+	// linked shader objects into the program object, so it no longer need:
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	// check for linking errors
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+		printf("ERROR::SHADER::PROGRAM:%s:LINKING_FAILED %s\n", name, infoLog);
+		glDeleteProgram(shaderProgram);
+		return 0;
+	}
+	return shaderProgram;
+}
+
+
+
+/**
+   Build all shader programs and cache location of uniforms
+*/
+static void init_shader_programs (void)
+{
+	extern unsigned int shaderProgram_video; // fixme: global variable
+	extern unsigned int shaderProgram_widget; // fixme: global variable
+	extern unsigned int shaderProgram_fire; // fixme: global variable
+	extern unsigned int shaderProgram_flow; // fixme: global variable
+	extern unsigned int shaderProgram_arrow; // fixme: global variable
+
+	const char *vertexShaderSource =
+		#include "GLSL/video.vert.quoted"
+		;
+	const char *fragmentShaderSource =
+		#include "GLSL/video.frag.quoted"
+		;
+	const char *vertexShaderSource_widget =
+		#include "GLSL/widget.vert.quoted"
+		;
+	const char *fragmentShaderSource_widget =
+		#include "GLSL/widget.frag.quoted"
+		;
+	const char *fragmentShaderSource_fire =
+		#include "GLSL/fire.frag.quoted"
+		;
+	const char *fragmentShaderSource_flow =
+		#include "GLSL/flow.frag.quoted"
+		;
+	const char *vertexShaderSource_arrow =
+		#include "GLSL/arrow.vert.quoted"
+		;
+
+	shaderProgram_video = build_shader_program(vertexShaderSource, fragmentShaderSource, "video");
+	shaderProgram_widget = build_shader_program(vertexShaderSource_widget, fragmentShaderSource_widget, "widget");
+	shaderProgram_fire = build_shader_program(vertexShaderSource_widget, fragmentShaderSource_fire, "fire");
+	shaderProgram_flow = build_shader_program(vertexShaderSource, fragmentShaderSource_flow, "flow");
+	shaderProgram_arrow = build_shader_program(vertexShaderSource_arrow, fragmentShaderSource_widget, "arrow");
+
+	// sampler of video always read texture unit 0: set once
+	uniform_video_texture = glGetUniformLocation(shaderProgram_video, "ourTexture");
+	glUseProgram(shaderProgram_video);
+	glUniform1i(uniform_video_texture, 0);
+
+	// luma in texture unit 0, shift of blocks in unit 1
+	glUseProgram(shaderProgram_flow);
+	glUniform1i(glGetUniformLocation(shaderProgram_flow, "lumaTexture"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgram_flow, "shiftTexture"), 1);
+	uniform_flow.image_size = glGetUniformLocation(shaderProgram_flow, "imageSize");
+	uniform_flow.block_size = glGetUniformLocation(shaderProgram_flow, "blockSize");
+	uniform_flow.max_shift = glGetUniformLocation(shaderProgram_flow, "maxShift");
+	uniform_flow.hide_static_block = glGetUniformLocation(shaderProgram_flow, "hideStaticBlock");
+
+	uniform_arrow.image_size = glGetUniformLocation(shaderProgram_arrow, "imageSize");
+	uniform_arrow.block_size = glGetUniformLocation(shaderProgram_arrow, "blockSize");
+	uniform_arrow.shift_scale = glGetUniformLocation(shaderProgram_arrow, "shiftScale");
+}
+
+
+
 /**
 
 return video_texture
@@ -91,8 +237,9 @@ unsigned int init_shader_video(void)
 {
 	extern GLFWwindow* window; // fixme: global variable
 
-	// build and compile our shader program
+	// build and compile our shader programs (once, not every frame)
 	// ------------------------------------
+	init_shader_programs();
 
 	// set up vertex data (and buffer(s)) and configure vertex attributes
 	// ------------------------------------------------------------------
@@ -135,6 +282,36 @@ unsigned int init_shader_video(void)
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 	glEnableVertexAttribArray(2);
 
+	// arrow glyph (GL_LINES: shaft and two lines of head), drawn once per moving block
+	float arrow[] = {
+		// along  back   side
+		0.0f,     0.0f,  0.0f,   1.0f, 0.0f,  0.0f, // shaft: center of block to center + shift
+		1.0f,     0.0f,  0.0f,   1.0f, 1.0f,  0.5f, // head
+		1.0f,     0.0f,  0.0f,   1.0f, 1.0f, -0.5f
+	};
+	glGenBuffers(1, &video_upload.arrow_instances);
+	glBindVertexArray(VAOs[SHADER_A]);
+	glBindBuffer(GL_ARRAY_BUFFER, VBOs[SHADER_A]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(arrow), arrow, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	// per instance: block and shift (int16_t, converted to float)
+	glBindBuffer(GL_ARRAY_BUFFER, video_upload.arrow_instances);
+	glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, 4 * sizeof(int16_t), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_FALSE, 4 * sizeof(int16_t), (void*)(2 * sizeof(int16_t)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+	glBindVertexArray(0);
+
+	// shift of blocks: integer texture, read by texelFetch (without filtering)
+	glGenTextures(1, &video_upload.shift_texture);
+	glBindTexture(GL_TEXTURE_2D, video_upload.shift_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
 	unsigned int video_texture;
 	glGenTextures(1, &video_texture); // This creates a new texture object (not need create every frame). The entire texture creation block up to and including the glTexImage2D() call should be done once in main(), but you should still call glBindTexture() in update().
 	return video_texture;
@@ -144,59 +321,34 @@ unsigned int init_shader_video(void)
 
 void use_shader_video ()
 {
+	extern unsigned int shaderProgram_video; // fixme: global variable
 	extern unsigned int VAOs[NUM_OF_SHADER]; // fixme: global variable
 
-	int success;
-	char infoLog[512];
+	// draw our first triangle
+	glUseProgram(shaderProgram_video);
 
-	// vertex shader
-	const char *vertexShaderSource =
-		#include "GLSL/video.vert.quoted"
-		;
-	unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-	glCompileShader(vertexShader);
-	// check for shader compile errors
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-	if(!success) {
-		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-		printf ("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n%s\n", infoLog);
-	}
+	glBindVertexArray(VAOs[SHADER_V]);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
 
-	// fragment shader
-	const char *fragmentShaderSource =
-		#include "GLSL/video.frag.quoted"
-		;
-	unsigned int fragmentShader;
-	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-	glCompileShader(fragmentShader);
-	// check if compilation was successful
-	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-	if(!success) {
-		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-		printf ("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n%s\n", infoLog);
-	}
 
-	// link shaders
-	extern unsigned int shaderProgram_video; // fixme: global variable
-	shaderProgram_video = glCreateProgram();
-	glAttachShader(shaderProgram_video, vertexShader);
-	glAttachShader(shaderProgram_video, fragmentShader);
-	glLinkProgram(shaderProgram_video);
-	// check for linking errors
-	glGetProgramiv(shaderProgram_video, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(shaderProgram_video, 512, NULL, infoLog);
-		printf("ERROR::SHADER::PROGRAM::LINKING_FAILED %s\n", infoLog);
-	}
-	// linked shader objects into the program object, so it no longer need:
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
 
+/* colorize luma by shift of blocks (see flow.frag) */
+static void use_shader_flow (GUI_FRAME* frame)
+{
+	extern unsigned int shaderProgram_flow; // fixme: global variable
+	extern unsigned int VAOs[NUM_OF_SHADER]; // fixme: global variable
+	extern _Atomic int hide_static_block;
 
-	// draw our first triangle
-	glUseProgram(shaderProgram_video);
+	glUseProgram(shaderProgram_flow);
+	glUniform2f(uniform_flow.image_size, frame->image->width, frame->image->height);
+	glUniform1f(uniform_flow.block_size, frame->block_size);
+	glUniform1f(uniform_flow.max_shift, frame->max_shift);
+	glUniform1i(uniform_flow.hide_static_block, atomic_load(&hide_static_block));
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, video_upload.shift_texture);
+	glActiveTexture(GL_TEXTURE0);
 
 	glBindVertexArray(VAOs[SHADER_V]);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
@@ -204,6 +356,27 @@ void use_shader_video ()
 
 
 
+/* overlay: one arrow per moving block (instanced, see arrow.vert) */
+static void use_shader_arrow (GUI_FRAME* frame)
+{
+	extern unsigned int shaderProgram_arrow; // fixme: global variable
+	extern unsigned int VAOs[NUM_OF_SHADER]; // fixme: global variable
+
+	glBindBuffer(GL_ARRAY_BUFFER, video_upload.arrow_instances);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(int16_t) * 4 * frame->arrow_count, frame->arrows, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(shaderProgram_arrow);
+	glUniform2f(uniform_arrow.image_size, frame->image->width, frame->image->height);
+	glUniform1f(uniform_arrow.block_size, frame->block_size);
+	glUniform1f(uniform_arrow.shift_scale, frame->shift_scale);
+
+	glBindVertexArray(VAOs[SHADER_A]);
+	glDrawArraysInstanced(GL_LINES, 0, 6, frame->arrow_count);
+}
+
+
+
 void init_shader_widget(unsigned long polylini_size, float *polyline)
 {
 	extern GLFWwindow* window; // fixme: global variable
@@ -229,64 +402,12 @@ void init_shader_widget(unsigned long polylini_size, float *polyline)
 */
 void use_shader_widget (unsigned long int num_components, unsigned long int sizeof_polyline, float *polyline, int size_point, int color_type)
 {
-	extern unsigned int VAOs[NUM_OF_SHADER]; // fixme: global variable
-
-	int success;
-	char infoLog[512];
-
-	// vertex shader
-	const char *vertexShaderSource_widget =
-		#include "GLSL/widget.vert.quoted"
-		;
-	unsigned int vertexShader_widget = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader_widget, 1, &vertexShaderSource_widget, NULL);
-	glCompileShader(vertexShader_widget);
-	// check for shader compile errors
-	glGetShaderiv(vertexShader_widget, GL_COMPILE_STATUS, &success);
-	if(!success) {
-		glGetShaderInfoLog(vertexShader_widget, 512, NULL, infoLog);
-		printf ("ERROR::SHADER::VERTEX:widget:COMPILATION_FAILED\n%s\n", infoLog);
-	}
-
-	// fragment shader
-	const char *fragmentShaderSource_widget =
-		#include "GLSL/widget.frag.quoted"
-		;
-
-	// fixme: replace to strstr, memcpy (but char * == const string)
-	const char *fragmentShaderSource_fire =
-		#include "GLSL/fire.frag.quoted"
-		;
-	unsigned int fragmentShader_widget;
-	fragmentShader_widget = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader_widget, 1, (color_type) ? &fragmentShaderSource_widget : &fragmentShaderSource_fire, NULL);
-	glCompileShader(fragmentShader_widget);
-	// check if compilation was successful
-	glGetShaderiv(fragmentShader_widget, GL_COMPILE_STATUS, &success);
-	if(!success) {
-		glGetShaderInfoLog(fragmentShader_widget, 512, NULL, infoLog);
-		printf ("ERROR::SHADER::FRAGMENT:widget:COMPILATION_FAILED\n%s\n", infoLog);
-	}
-
-	// link shaders
 	extern unsigned int shaderProgram_widget; // fixme: global variable
-	shaderProgram_widget = glCreateProgram();
-	glAttachShader(shaderProgram_widget, vertexShader_widget);
-	glAttachShader(shaderProgram_widget, fragmentShader_widget);
-	glLinkProgram(shaderProgram_widget);
-	// check for linking errors
-	glGetProgramiv(shaderProgram_widget, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(shaderProgram_widget, 512, NULL, infoLog);
-		printf("ERROR::SHADER::PROGRAM::LINKING_FAILED %s\n", infoLog);
-	}
-	// linked shader objects into the program object, so it no longer need:
-	glDeleteShader(vertexShader_widget);
-	glDeleteShader(fragmentShader_widget);
-
+	extern unsigned int shaderProgram_fire; // fixme: global variable
+	extern unsigned int VAOs[NUM_OF_SHADER]; // fixme: global variable
 
 	// draw our first triangle
-	glUseProgram(shaderProgram_widget);
+	glUseProgram((color_type) ? shaderProgram_widget : shaderProgram_fire);
 
 	unsigned long int number_vertices_polyline = sizeof_polyline / sizeof(polyline[0]) / num_components;
 
@@ -311,8 +432,10 @@ void use_shader_widget (unsigned long int num_components, unsigned long int size
 
    \return press_key
 */
-void render_loop (struct imgRawImage* gui_image, unsigned int video_texture)
+void render_loop (GUI_FRAME* frame, unsigned int video_texture)
 {
+	struct imgRawImage* gui_image = frame->image;
+	GLenum format = (gui_image->numComponents == 1) ? GL_RED : GL_RGB;
 	extern GLFWwindow* window; // fixme: global variable
 	extern unsigned int shaderProgram_video; // fixme: global variable
 	extern unsigned int shaderProgram_widget; // fixme: global variable
@@ -322,26 +445,69 @@ void render_loop (struct imgRawImage* gui_image, unsigned int video_texture)
 
 
 
-	// load and create a texture
-	// -------------------------
-
-	glBindTexture(GL_TEXTURE_2D, video_texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	if (gui_image->lpData == NULL) {
+		printf("Failed to load texture\n");
+	} else if (video_upload.width != gui_image->width || video_upload.height != gui_image->height ||
+		   video_upload.components != gui_image->numComponents) {
+		// storage of texture and pixel buffers allocated once (again only if size of frame changed)
+		glBindTexture(GL_TEXTURE_2D, video_texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
+		// set the texture wrapping parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		// set texture filtering parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0); // without mipmaps
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of RGB image not aligned to 4 bytes
+		glTexImage2D(GL_TEXTURE_2D, 0, (format == GL_RED) ? GL_R8 : GL_RGB8, gui_image->width, gui_image->height, 0, format, GL_UNSIGNED_BYTE, NULL);
+
+		video_upload.size = (size_t)gui_image->width * gui_image->height * gui_image->numComponents;
+		if (video_upload.pbo[0] == 0) glGenBuffers(2, video_upload.pbo);
+		for (int i = 0; i < 2; i++) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video_upload.pbo[i]);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, video_upload.size, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		video_upload.index = 0;
+		video_upload.width = gui_image->width;
+		video_upload.height = gui_image->height;
+		video_upload.components = gui_image->numComponents;
+
+		// fit viewport to proportion of new image
+		int window_width, window_height;
+		glfwGetFramebufferSize(window, &window_width, &window_height);
+		framebuffer_size_callback(window, window_width, window_height);
+	}
 
-	// load image, create texture and generate mipmaps
-	if (gui_image->lpData) // fixme: work?
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, gui_image->width, gui_image->height, 0, GL_RGB, GL_UNSIGNED_BYTE, gui_image->lpData);
-		//glGenerateMipmap(GL_TEXTURE_2D);
+	if (gui_image->lpData != NULL) {
+		// copy frame into pixel buffer; transfer into texture by glTexSubImage2D from buffer is
+		// asynchronous (DMA), copy of next frame go to other buffer without wait it
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video_upload.pbo[video_upload.index]);
+		void *pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, video_upload.size,
+						GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (pixels != NULL) {
+			memcpy(pixels, gui_image->lpData, video_upload.size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindTexture(GL_TEXTURE_2D, video_texture);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, video_upload.width, video_upload.height,
+					format, GL_UNSIGNED_BYTE, (void*)0); // offset in bound pixel buffer
+		} else {
+			printf("Failed to map pixel buffer\n");
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		video_upload.index = 1 - video_upload.index;
 	}
-	else
-	{
-		printf("Failed to load texture\n");
+
+	if (frame->shift != NULL) {
+		// few kilobytes: uploaded directly
+		glBindTexture(GL_TEXTURE_2D, video_upload.shift_texture);
+		if (video_upload.grid_width != frame->grid_width || video_upload.grid_height != frame->grid_height) {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16I, frame->grid_width, frame->grid_height, 0, GL_RG_INTEGER, GL_SHORT, frame->shift);
+			video_upload.grid_width = frame->grid_width;
+			video_upload.grid_height = frame->grid_height;
+		} else {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->grid_width, frame->grid_height, GL_RG_INTEGER, GL_SHORT, frame->shift);
+		}
 	}
 
 
@@ -365,7 +531,14 @@ void render_loop (struct imgRawImage* gui_image, unsigned int video_texture)
 		glBindTexture(GL_TEXTURE_2D, video_texture);
 
 		// render container
-		use_shader_video();
+		if (frame->shift != NULL) {
+			use_shader_flow(frame);
+		} else {
+			use_shader_video();
+		}
+		if (frame->arrow_count > 0) {
+			use_shader_arrow(frame);
+		}
 
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -382,6 +555,9 @@ void deallocate_resources (void)
 	extern GLFWwindow* window; // fixme: global variable
 	extern unsigned int shaderProgram_video; // fixme: global variable
 	extern unsigned int shaderProgram_widget; // fixme: global variable
+	extern unsigned int shaderProgram_fire; // fixme: global variable
+	extern unsigned int shaderProgram_flow; // fixme: global variable
+	extern unsigned int shaderProgram_arrow; // fixme: global variable
 	extern unsigned int VBOs[NUM_OF_SHADER]; // fixme: global variable
 	extern unsigned int VAOs[NUM_OF_SHADER]; // fixme: global variable
 	extern unsigned int EBOs[NUM_OF_SHADER]; // fixme: global variable
@@ -390,10 +566,23 @@ void deallocate_resources (void)
 	glDeleteVertexArrays(NUM_OF_SHADER, VAOs);
 	glDeleteBuffers(NUM_OF_SHADER, VBOs);
 	glDeleteBuffers(NUM_OF_SHADER, EBOs);
+	glDeleteBuffers(2, video_upload.pbo);
+	glDeleteTextures(1, &video_upload.shift_texture);
+	glDeleteBuffers(1, &video_upload.arrow_instances);
+
+	// frames published after end of display loop
+	pthread_mutex_lock(&gui_display.mutex);
+	free_frame(gui_display.pending);
+	free_frame(gui_display.spare);
+	gui_display.pending = NULL;
+	gui_display.spare = NULL;
+	pthread_mutex_unlock(&gui_display.mutex);
 
-	// fixme: need?
 	glDeleteProgram(shaderProgram_video);
 	glDeleteProgram(shaderProgram_widget);
+	glDeleteProgram(shaderProgram_fire);
+	glDeleteProgram(shaderProgram_flow);
+	glDeleteProgram(shaderProgram_arrow);
 
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
@@ -408,13 +597,14 @@ void deallocate_resources (void)
 /* if window change size */
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	extern struct imgRawImage* gui_image; // fixme: global variable
 	extern float glob_zoom_ratio;
 	extern float glob_canvas_shift_y;
 
 	(void)window; // suppress "unused parameter" warnings
 
-	float i_proportion = (float)gui_image->width / (float)gui_image->height;
+	// size of displayed image (frames owned by processing thread, see gui_publish_image)
+	if (video_upload.width == 0 || video_upload.height == 0) return;
+	float i_proportion = (float)video_upload.width / (float)video_upload.height;
 	float c_proportion = (float)width / (float)height;
 
 	int proportional_height = height;
@@ -427,7 +617,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 		glViewport(0, 0, width, proportional_height);
 	}
 
-	glob_zoom_ratio = get_zoom_ratio (width, height, gui_image->width, gui_image->height);
+	glob_zoom_ratio = get_zoom_ratio (width, height, video_upload.width, video_upload.height);
 	glob_canvas_shift_y = -(height - proportional_height) / glob_zoom_ratio;
 }
 
@@ -439,24 +629,36 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	(void)scancode; // suppress "unused parameter" warnings
 	(void)mods; // suppress "unused parameter" warnings
 
-	extern int hide_static_block;
-	extern int escape_status;
+	extern _Atomic int hide_static_block;
+	extern _Atomic int escape_status;
 	extern int verbose_type;
+	extern int verbose;
 
 	const char* keyName;
 
 	switch (key) {
 	case GLFW_KEY_ESCAPE:
-		escape_status = true;
+		atomic_store(&escape_status, true);
+		gui_wake_step(); // processing waiting for step stopped too
 		break;
 	case GLFW_KEY_SPACE:
 		if (action == GLFW_PRESS || action == GLFW_REPEAT) {
-			hide_static_block ^= 1;
+			if (verbose & VERBOSE_STEP_BY_STEP) {
+				pthread_mutex_lock(&gui_display.mutex);
+				gui_display.step = true; // next step
+				pthread_cond_signal(&gui_display.step_cond);
+				pthread_mutex_unlock(&gui_display.mutex);
+			} else {
+				atomic_fetch_xor(&hide_static_block, 1);
+			}
 		}
 		break;
 	default:
 		keyName = glfwGetKeyName(key, 0);
 		if (keyName == NULL) return;
+		if ('a' == keyName[0] && 0 == keyName[1] && action == GLFW_PRESS) {
+			atomic_fetch_xor(&show_arrows, 1); // overlay from next frame
+		}
 		if( 'v' == keyName[0] && 0 == keyName[1] && action == GLFW_PRESS) {
 			verbose_type++;
 			switch (verbose_type) {
@@ -494,26 +696,252 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 
 
 
-void * start_gui_process(void *arguments)
+/* take buffers of displayed frame for next publish (called by processing thread), NULL === out of memory */
+static GUI_FRAME* take_spare_frame (unsigned long int width, unsigned long int height, int components)
 {
-	extern GLFWwindow* window; // fixme: global variable
-	int index = *((int *)arguments);
-	printf("gui started. thread: %d\n", index);
+	pthread_mutex_lock(&gui_display.mutex);
+	GUI_FRAME* frame = gui_display.spare;
+	gui_display.spare = NULL;
+	pthread_mutex_unlock(&gui_display.mutex);
+
+	if (frame == NULL) {
+		frame = (GUI_FRAME*)calloc(1, sizeof(GUI_FRAME));
+		if (frame == NULL) {
+			printf("error: not enough memory for frame of display\n");
+			return NULL;
+		}
+	}
+	unsigned long int size = width * height * components;
+	if (frame->image != NULL && frame->image->dwBufferBytes != size) {
+		free_image(frame->image);
+		frame->image = NULL;
+	}
+	if (frame->image == NULL) {
+		frame->image = (struct imgRawImage*)malloc(sizeof(struct imgRawImage));
+		if (frame->image != NULL) {
+			frame->image->lpData = (unsigned char*)malloc(sizeof(unsigned char) * size);
+			frame->image->dwBufferBytes = size;
+		}
+		if (frame->image == NULL || frame->image->lpData == NULL) {
+			printf("error: not enough memory for image of display (%lu bytes)\n", size);
+			free_frame(frame);
+			return NULL;
+		}
+	}
+	frame->image->width = width;
+	frame->image->height = height;
+	frame->image->numComponents = components;
+	return frame;
+}
 
-	/* Loop until the user closes the window */
-	while (!glfwWindowShouldClose(window)) {
-		// Render here
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		//render_loop();
 
-		// Swap front and back buffers
-		glfwSwapBuffers(window);
 
-		// Poll for and process events
-		glfwPollEvents();
+/* latest frame for display thread: older frame, not displayed yet, replaced */
+static void put_pending_frame (GUI_FRAME* frame)
+{
+	pthread_mutex_lock(&gui_display.mutex);
+	GUI_FRAME* old = gui_display.pending;
+	gui_display.pending = frame;
+	if (gui_display.spare == NULL) {
+		gui_display.spare = old;
+		old = NULL;
 	}
-	return NULL;
+	pthread_mutex_unlock(&gui_display.mutex);
+	free_frame(old);
+
+	glfwPostEmptyEvent(); // wake up display thread
+}
+
+
+
+/* moving blocks of flow for arrow overlay (blocks without shift culled) */
+static void set_frame_arrows (GUI_FRAME* frame, OPTICAL_FLOW* flow)
+{
+	frame->arrow_count = 0;
+	if (!atomic_load(&show_arrows) || flow == NULL) return;
+
+	if (frame->arrows_capacity < flow->array_size) {
+		free(frame->arrows);
+		frame->arrows = (int16_t*)malloc(sizeof(int16_t) * 4 * flow->array_size);
+		frame->arrows_capacity = (frame->arrows != NULL) ? flow->array_size : 0;
+	}
+	if (frame->arrows == NULL) {
+		// out of memory: frame without arrows
+		printf("error: not enough memory for arrows of %lu blocks\n", flow->array_size);
+		return;
+	}
+	for (unsigned long int i = 0; i < flow->array_size; i++) {
+		COORD_2D shift = flow->array[i].shift;
+		if (shift.x != 0 || shift.y != 0) {
+			int16_t *arrow = frame->arrows + 4 * frame->arrow_count;
+			arrow[0] = i % flow->width;
+			arrow[1] = i / flow->width;
+			arrow[2] = shift.x;
+			arrow[3] = shift.y;
+			frame->arrow_count++;
+		}
+	}
+	frame->block_size = flow->block_size_in_pixel * flow->analysis_scale;
+	frame->shift_scale = flow->analysis_scale;
+}
+
+
+
+/**
+   Pass drawn frame to display thread (called by processing thread)
+
+   Image copied: caller still own it. If display not ready (vertical sync),
+   previous frame not displayed yet replaced, processing never wait.
+
+   \param flow arrows of moving blocks drawn over image (NULL === without arrows)
+*/
+void gui_publish_image (struct imgRawImage* image, OPTICAL_FLOW* flow)
+{
+	GUI_FRAME* frame = take_spare_frame(image->width, image->height, image->numComponents);
+	if (frame == NULL) return; // out of memory: frame not displayed
+	memcpy(frame->image->lpData, image->lpData, image->dwBufferBytes);
+	free(frame->shift);
+	frame->shift = NULL;
+	frame->shift_capacity = 0;
+	set_frame_arrows(frame, flow);
+	put_pending_frame(frame);
+}
+
+
+
+/**
+   Pass frame and optical flow to display thread: colorized by flow.frag
+   (without colorize() on CPU and with upload of luma only)
+
+   \param image frame at display resolution (luma or RGB)
+   \param flow NULL === optical flow not calculated (first frame): luma only
+*/
+void gui_publish_flow (struct imgRawImage* image, OPTICAL_FLOW* flow)
+{
+	GUI_FRAME* frame = take_spare_frame(image->width, image->height, 1);
+	if (frame == NULL) return; // out of memory: frame not displayed
+	unsigned char *luma = frame->image->lpData;
+	if (image->numComponents == 1) {
+		memcpy(luma, image->lpData, frame->image->dwBufferBytes);
+	} else {
+		// as monochrome() in block-matching.c: 0.2125 R + 0.7154 G + 0.0721 B
+		const unsigned char *rgb = image->lpData;
+		for (unsigned long int i = 0; i < frame->image->dwBufferBytes; i++, rgb += image->numComponents) {
+			luma[i] = (54 * rgb[R] + 183 * rgb[G] + 19 * rgb[B]) >> 8;
+		}
+	}
+
+	size_t blocks = (flow != NULL) ? flow->array_size : 1;
+	if (frame->shift_capacity < blocks) {
+		free(frame->shift);
+		frame->shift = (int16_t*)malloc(sizeof(int16_t) * 2 * blocks);
+		frame->shift_capacity = (frame->shift != NULL) ? blocks : 0;
+	}
+	if (frame->shift == NULL) {
+		// out of memory: luma only (drawn by video shader, as gui_publish_image)
+		printf("error: not enough memory for shift of %zu blocks\n", blocks);
+		flow = NULL;
+	} else if (flow != NULL) {
+		for (size_t i = 0; i < blocks; i++) {
+			frame->shift[2*i]     = flow->array[i].shift.x;
+			frame->shift[2*i + 1] = flow->array[i].shift.y;
+		}
+		frame->grid_width = flow->width;
+		frame->grid_height = flow->height;
+		frame->block_size = flow->block_size_in_pixel * flow->analysis_scale;
+		frame->max_shift = (int)sqrt(2.0 * (double)SQUARE (flow->max_shift_global + flow->max_shift_local));
+	} else {
+		frame->shift[0] = 0;
+		frame->shift[1] = 0;
+		frame->grid_width = 1;
+		frame->grid_height = 1;
+		frame->block_size = 1.0;
+		frame->max_shift = 1.0;
+	}
+	set_frame_arrows(frame, flow);
+	put_pending_frame(frame);
+}
+
+
+
+/**
+   Step-by-step mode: processing thread wait until space pressed (or window closed)
+*/
+void gui_wait_step (void)
+{
+	extern _Atomic int escape_status;
+
+	pthread_mutex_lock(&gui_display.mutex);
+	while (gui_display.step == false && atomic_load(&escape_status) == false && gui_display.finished == false) {
+		pthread_cond_wait(&gui_display.step_cond, &gui_display.mutex);
+	}
+	gui_display.step = false;
+	pthread_mutex_unlock(&gui_display.mutex);
+}
+
+
+
+/* wake up processing thread waiting for step: program stopped */
+void gui_wake_step (void)
+{
+	pthread_mutex_lock(&gui_display.mutex);
+	pthread_cond_broadcast(&gui_display.step_cond);
+	pthread_mutex_unlock(&gui_display.mutex);
+}
+
+
+
+/* processing ended (called by processing thread): display loop stop */
+void gui_finish (void)
+{
+	pthread_mutex_lock(&gui_display.mutex);
+	gui_display.finished = true;
+	pthread_cond_broadcast(&gui_display.step_cond);
+	pthread_mutex_unlock(&gui_display.mutex);
+	glfwPostEmptyEvent();
+}
+
+
+
+/**
+   Display loop of main thread (owner of OpenGL context and window events):
+   show latest published frame at display rate, while processing thread not throttled
+
+   Ended by gui_finish() or by closing window (escape_status set: processing stopped)
+*/
+void gui_display_loop (unsigned int video_texture)
+{
+	extern GLFWwindow* window; // fixme: global variable
+	extern _Atomic int escape_status;
+
+	while (atomic_load(&escape_status) == false) {
+		pthread_mutex_lock(&gui_display.mutex);
+		int finished = gui_display.finished;
+		GUI_FRAME* frame = gui_display.pending;
+		gui_display.pending = NULL;
+		pthread_mutex_unlock(&gui_display.mutex);
+
+		if (frame != NULL) {
+			render_loop(frame, video_texture); // upload, draw, swap (wait vertical sync) and poll events
+
+			pthread_mutex_lock(&gui_display.mutex);
+			if (gui_display.spare == NULL) {
+				gui_display.spare = frame;
+				frame = NULL;
+			}
+			pthread_mutex_unlock(&gui_display.mutex);
+			free_frame(frame);
+		} else if (finished) {
+			break; // last frame displayed
+		} else {
+			glfwWaitEventsTimeout(GUI_IDLE_TIMEOUT); // woken up by new frame, input or end of processing
+		}
+
+		if (glfwWindowShouldClose(window)) {
+			atomic_store(&escape_status, true);
+		}
+	}
+	gui_wake_step();
 }
 
 
@@ -557,8 +985,6 @@ void draw_crosshair (struct imgRawImage* image)
 void draw_graph (struct imgRawImage* draw_image, int len_data, float * data, int shift_x, int shift_y, int size_x, int size_y, int color)
 {
 	extern int verbose;
-	extern int escape_status;
-	extern unsigned int video_texture;
 
 	struct coord_2Du coord;
 
@@ -586,15 +1012,9 @@ void draw_graph (struct imgRawImage* draw_image, int len_data, float * data, int
 		}
 	}
 
-	if (verbose & VERBOSE_STEP_BY_STEP)
-		space_step = true;
-	while (space_step && !escape_status) {
-		glfwWaitEvents(); // glfwWaitEventsTimeout(1.0);
-		glfwPollEvents();
-	}
-
 	if (verbose & VERBOSE_VIDEO && verbose & VERBOSE_STEP_BY_STEP) {
-		render_loop (draw_image, video_texture);
+		gui_publish_image(draw_image, NULL); // displayed by main thread
+		gui_wait_step();
 	}
 
 }
@@ -24,16 +24,22 @@
 
 #define MAX_FNAME_LEN 128
 
-#define NUM_OF_SHADER 2
+#define NUM_OF_SHADER 3
 #define SHADER_V 0
 #define SHADER_W 1
+#define SHADER_A 2
 
 int init_gui (unsigned int src_width, unsigned int src_height);
 unsigned int init_shader_video(void);
 void init_shader_widget(unsigned long polylini_size, float *polyline);
-void render_loop (struct imgRawImage* gui_image, unsigned int video_texture);
+void render_loop (GUI_FRAME* frame, unsigned int video_texture);
 void deallocate_resources (void);
-void * start_gui_process(void *arguments);
+void gui_publish_image (struct imgRawImage* image, OPTICAL_FLOW* flow);
+void gui_publish_flow (struct imgRawImage* image, OPTICAL_FLOW* flow);
+void gui_wait_step (void);
+void gui_wake_step (void);
+void gui_finish (void);
+void gui_display_loop (unsigned int video_texture);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 int processInput(GLFWwindow *window);
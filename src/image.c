@@ -45,11 +45,14 @@ Code:
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <jpeglib.h>
 #include <jerror.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
 
 
 #include "image-type.h"
@@ -57,6 +60,13 @@ Code:
 #include "const.h"
 #include "gui.h"
 #include "block-matching.h"
+#include "jpeg-writer.h"
+#include "video-writer.h"
+#include "flow-file.h"
+#include "shm-ring.h"
+#include "flow-stream.h"
+#include "mjpeg-server.h"
+#include "event-recorder.h"
 
 struct imgRawImage* loadJpegImageFile(char* lpFilename) {
 	struct jpeg_decompress_struct info;
@@ -200,6 +210,16 @@ struct imgRawImage* loadJpegImage(const void *jpg_buffer, int jpg_size) {
 
 
 int storeJpegImageFile(struct imgRawImage* lpImage, char* lpFilename) {
+	return storeJpegImageFileQuality(lpImage, lpFilename, 100, false);
+}
+
+
+
+/**
+   \param quality 0..100
+   \param fast_dct JDCT_IFAST: faster compression, less accurate (visible only on high quality)
+*/
+int storeJpegImageFileQuality(struct imgRawImage* lpImage, char* lpFilename, int quality, int fast_dct) {
 	struct jpeg_compress_struct info;
 	struct jpeg_error_mgr err;
 
@@ -226,7 +246,8 @@ int storeJpegImageFile(struct imgRawImage* lpImage, char* lpFilename) {
 	info.in_color_space = JCS_RGB;
 
 	jpeg_set_defaults(&info);
-	jpeg_set_quality(&info, 100, TRUE);
+	jpeg_set_quality(&info, quality, TRUE);
+	if (fast_dct) info.dct_method = JDCT_IFAST;
 
 	jpeg_start_compress(&info, TRUE);
 
@@ -245,38 +266,214 @@ int storeJpegImageFile(struct imgRawImage* lpImage, char* lpFilename) {
 
 
 
-void process_image(AVFrame *pFrameRGB, int frame_count, int compare_with_first, int verbose, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow)
+/**
+   Compress RGB image into memory buffer
+
+   \param flip image stored bottom to top (OpenGL texture, see frame_to_image): write rows in reverse order
+   \param buffer allocated by libjpeg (reused if not NULL), free by caller
+*/
+int encodeJpegImageMemory(struct imgRawImage* lpImage, int quality, int flip, unsigned char **buffer, unsigned long *size) {
+	struct jpeg_compress_struct info;
+	struct jpeg_error_mgr err;
+
+	unsigned char* lpRowBuffer[1];
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_compress(&info);
+
+	jpeg_mem_dest(&info, buffer, size);
+
+	info.image_width = lpImage->width;
+	info.image_height = lpImage->height;
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, quality, TRUE);
+	info.dct_method = JDCT_IFAST;
+
+	jpeg_start_compress(&info, TRUE);
+
+	while(info.next_scanline < info.image_height) {
+		unsigned long row = flip ? (info.image_height - 1 - info.next_scanline) : info.next_scanline;
+		lpRowBuffer[0] = &(lpImage->lpData[row * (lpImage->width * 3)]);
+		jpeg_write_scanlines(&info, lpRowBuffer, 1);
+	}
+
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+	return 0;
+}
+
+
+
+/**
+   Copy frame into new image
+
+   also flip image by horizontal axis (OpenGL texture are loaded left to right, bottom to top)
+
+   YUYV frame (V4L2) with num_components == 1: luma extracted while copy
+*/
+struct imgRawImage* frame_to_image(AVFrame *pFrameRGB, int num_components)
+{
+	return frame_into_image(pFrameRGB, num_components, NULL);
+}
+
+
+
+/**
+   Copy frame into image (see frame_to_image), buffer of image reused if size match
+
+   \param image owned by function (reused or freed), NULL === new image allocated
+   \return NULL === out of memory
+*/
+struct imgRawImage* frame_into_image(AVFrame *pFrameRGB, int num_components, struct imgRawImage* image)
 {
-	extern struct imgRawImage* raw_image; // fixme: global variable
-	extern struct imgRawImage* gui_image; // fixme: global variable
-	extern struct imgRawImage* old_image; // fixme: global variable
-	//extern OPTICAL_FLOW* flow; // fixem: global variable
-
-	raw_image = (struct imgRawImage*)malloc(sizeof(struct imgRawImage));
-	raw_image->numComponents = num_components;
-	raw_image->width = pFrameRGB->width;
-	raw_image->height = pFrameRGB->height;
-	raw_image->dwBufferBytes = pFrameRGB->width * pFrameRGB->height * num_components;
-	raw_image->lpData = (unsigned char*)malloc(sizeof(unsigned char) * (raw_image->dwBufferBytes));
-
-	// memcpy(raw_image->lpData, pFrameRGB->data[0], sizeof(unsigned char) * raw_image->dwBufferBytes);
+	unsigned long int buffer_bytes = (unsigned long int)pFrameRGB->width * pFrameRGB->height * num_components;
+	if (image != NULL && image->dwBufferBytes != buffer_bytes) {
+		free(image->lpData);
+		free(image);
+		image = NULL;
+	}
+	if (image == NULL) {
+		image = (struct imgRawImage*)malloc(sizeof(struct imgRawImage));
+		if (image == NULL) return NULL;
+		image->lpData = (unsigned char*)malloc(sizeof(unsigned char) * buffer_bytes);
+		if (image->lpData == NULL) {
+			free(image);
+			return NULL;
+		}
+	}
+	image->numComponents = num_components;
+	image->width = pFrameRGB->width;
+	image->height = pFrameRGB->height;
+	image->dwBufferBytes = buffer_bytes;
+
+	// memcpy(image->lpData, pFrameRGB->data[0], sizeof(unsigned char) * image->dwBufferBytes);
 	//
 	// also need flip image by horizontal axis:
-	int rgb_linesize = pFrameRGB->linesize[0];
-	for (unsigned long int j=0; j < raw_image->dwBufferBytes; j += rgb_linesize) {
-		int image_base_index = raw_image->dwBufferBytes - rgb_linesize - j;
-		int rgb_base_index   = j;
-		memcpy(&(raw_image->lpData[image_base_index]), &(pFrameRGB->data[0][rgb_base_index]), sizeof(unsigned char) * rgb_linesize);
+	unsigned long int image_linesize = image->width * num_components;
+	int rgb_linesize = pFrameRGB->linesize[0]; // may be padded (V4L2 bytesperline)
+	int yuyv_luma = (pFrameRGB->format == AV_PIX_FMT_YUYV422 && num_components == 1);
+	for (unsigned long int j=0; j < image->height; j++) {
+		unsigned char *image_row = &(image->lpData[(image->height - 1 - j) * image_linesize]);
+		unsigned char *rgb_row   = &(pFrameRGB->data[0][j * rgb_linesize]);
+		if (yuyv_luma) {
+			// packed Y0 U Y1 V: take luma only
+			for (unsigned long int i=0; i < image->width; i++) {
+				image_row[i] = rgb_row[2 * i];
+			}
+		} else {
+			memcpy(image_row, rgb_row, sizeof(unsigned char) * image_linesize);
+		}
+	}
+
+	return image;
+}
+
+
+
+struct imgRawImage* copy_image(struct imgRawImage* image)
+{
+	struct imgRawImage* copy = (struct imgRawImage*)malloc(sizeof(struct imgRawImage));
+	*copy = *image;
+	copy->lpData = (unsigned char*)malloc(sizeof(unsigned char) * (image->dwBufferBytes));
+	memcpy(copy->lpData, image->lpData, sizeof(unsigned char) * image->dwBufferBytes);
+	return copy;
+}
+
+
+
+/**
+   Write frame into outputs: flow file, video, JPEG file
+
+   \param time pts of frame in microseconds (AV_NOPTS_VALUE === unknown)
+   \param draw_image owned by function (passed to writers or freed), NULL === nothing drawn
+   \param flow NULL === optical flow not calculated for frame (first frame)
+*/
+static void save_outputs(int frame_count, int64_t time, struct imgRawImage* draw_image, int save_image, OPTICAL_FLOW* flow)
+{
+	extern JPEG_WRITER* jpeg_writer; // fixme: global variable (NULL === save synchronously)
+	extern VIDEO_WRITER* video_writer; // fixme: global variable (NULL === without video output)
+	extern FLOW_FILE* flow_file; // fixme: global variable (NULL === flow not saved)
+
+	if (flow_file != NULL && flow != NULL) {
+		write_flow_frame(flow_file, frame_count, flow);
+	}
+
+	if (video_writer != NULL && draw_image != NULL) {
+		// image owned by writer (copy if JPEG saved too)
+		video_writer_submit(video_writer, save_image ? copy_image(draw_image) : draw_image, time);
+		if (!save_image) draw_image = NULL;
+	}
+
+	if (save_image && draw_image != NULL) {
+		// save frame as a JPEG file
+		char file_name[MAX_FNAME_LEN];
+		sprintf(file_name, "/tmp/image_%04d.jpeg", frame_count);
+		if (jpeg_writer != NULL) {
+			jpeg_writer_submit(jpeg_writer, draw_image, file_name); // image owned by writer
+			draw_image = NULL;
+		} else {
+			int ret;
+			ret = storeJpegImageFile(draw_image, file_name);
+			if (ret != 0) printf("error store jpeg file");
+		}
+	}
+
+	if (draw_image != NULL) {
+		free(draw_image->lpData);
+		free(draw_image);
+	}
+}
+
+
+
+/**
+   \param pFrameDisplay full resolution frame for drawing result, if optical flow calculated on reduced pFrameRGB (NULL === same as pFrameRGB)
+*/
+void process_image(AVFrame *pFrameRGB, AVFrame *pFrameDisplay, int frame_count, int compare_with_first, int verbose, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow)
+{
+	extern VIDEO_WRITER* video_writer; // fixme: global variable (NULL === without video output)
+	extern FLOW_FILE* flow_file; // fixme: global variable (NULL === flow not saved)
+	extern SHM_RING* shm_ring; // fixme: global variable (NULL === flow not exported)
+	extern FLOW_STREAM* flow_stream; // fixme: global variable (NULL === flow not streamed)
+	extern MJPEG_SERVER* mjpeg_server; // fixme: global variable (NULL === without HTTP preview)
+	extern EVENT_RECORDER* event_recorder; // fixme: global variable (NULL === all frames written)
+
+	// previous image stored in flow: contexts (segments of file, see segments.c) are independent
+	// frame copied (and flipped) into buffer of image replaced last frame: no allocation per frame
+	struct imgRawImage* raw_image = frame_into_image(pFrameRGB, num_components, flow->spare_image);
+	flow->spare_image = NULL;
+	if (raw_image == NULL) {
+		printf("error: not enough memory for frame %d\n", frame_count);
+		return;
 	}
+	struct imgRawImage* old_image = flow->old_image;
+	struct imgRawImage* draw_image = NULL;
+
+	// optical flow calculated on (reduced) analysis image, but drawn on full resolution display image
+	struct imgRawImage* display_image = raw_image;
 
-	if (verbose != VERBOSE_NO) {
-		gui_image = (struct imgRawImage*)malloc(sizeof(struct imgRawImage));
-		gui_image->numComponents = raw_image->numComponents;
-		gui_image->width         = raw_image->width;
-		gui_image->height        = raw_image->height;
-		gui_image->dwBufferBytes = raw_image->dwBufferBytes;
-		gui_image->lpData = (unsigned char*)malloc(sizeof(unsigned char) * (gui_image->dwBufferBytes));
-		//memcpy(gui_image->lpData, raw_image->lpData, sizeof(unsigned char) * gui_image->dwBufferBytes);
+	// preview drawn only if somebody watch it and next preview frame is due (not every frame of source)
+	int preview = (mjpeg_server != NULL && flow->warm_up == false && mjpeg_server_frame_due(mjpeg_server));
+
+	// window only user of drawn image: colorized by shader from luma and shift of blocks (see flow.frag)
+	int gpu_colorize = ((verbose & VERBOSE_VIDEO) && !(verbose & VERBOSE_IMAGE) && video_writer == NULL && !preview);
+
+	if (verbose != VERBOSE_NO || video_writer != NULL || preview) {
+		if (pFrameDisplay != NULL) {
+			display_image = frame_to_image(pFrameDisplay, num_components);
+		}
+	}
+	if ((verbose != VERBOSE_NO && !gpu_colorize) || video_writer != NULL || preview) {
+		draw_image = (struct imgRawImage*)malloc(sizeof(struct imgRawImage));
+		draw_image->numComponents = NUM_COMPONENTS_RGB; // gray source (raw input) colorized too
+		draw_image->width         = display_image->width;
+		draw_image->height        = display_image->height;
+		draw_image->dwBufferBytes = display_image->width * display_image->height * NUM_COMPONENTS_RGB;
+		draw_image->lpData = (unsigned char*)malloc(sizeof(unsigned char) * (draw_image->dwBufferBytes));
+		//memcpy(draw_image->lpData, raw_image->lpData, sizeof(unsigned char) * draw_image->dwBufferBytes);
 	}
 
 	if (old_image != NULL) {
@@ -285,33 +482,30 @@ void process_image(AVFrame *pFrameRGB, int frame_count, int compare_with_first,
 
 		// start timer
 		struct timespec ts_start;
-		struct timespec ts_current;
 		clock_gettime(CLOCK_MONOTONIC, &ts_start);
 
 
 
 		pthread_t thread_optical_flow;
 		atomic_store(&(flow->semaphore_optical_flow), true);
-		flow->old_image = old_image;
 		flow->raw_image = raw_image;
-		flow->gui_image = gui_image;
+		flow->gui_image = draw_image; // without verbose and video output nothing to draw (NULL)
+		flow->display_image = display_image;
 
 		int result_code = pthread_create(&thread_optical_flow, NULL, block_matching_optimized_images, flow);
 		assert(!result_code);
 
 
 
-		// wait ... and try stop parallel process
-		long int time_duration;
+		// wait (sleep: core left to optical flow thread, segments not oversubscribe cores) ... and try stop parallel process
+		struct timespec ts_deadline = ts_start;
 		int counter = 0;
-		do {
-			clock_gettime(CLOCK_MONOTONIC, &ts_current);
-			if (ts_current.tv_sec - ts_start.tv_sec == 0) {
-				time_duration = ts_current.tv_nsec - ts_start.tv_nsec;
-			} else { // fixme: if more than one seconds, then need add seconds diff
-				time_duration = (NANOSECONDS_IN_SECOND - ts_start.tv_nsec) + ts_current.tv_nsec;
-			}
-		} while (time_duration < NANOSECONDS_IN_SECOND / OPTICAL_FLOW_FPS);
+		ts_deadline.tv_nsec += NANOSECONDS_IN_SECOND / OPTICAL_FLOW_FPS;
+		if (ts_deadline.tv_nsec >= NANOSECONDS_IN_SECOND) {
+			ts_deadline.tv_sec++;
+			ts_deadline.tv_nsec -= NANOSECONDS_IN_SECOND;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts_deadline, NULL) == EINTR);
 		atomic_store(&(flow->semaphore_optical_flow), false); // try stop parallel process
 		printf("%d ", counter);
 
@@ -319,41 +513,88 @@ void process_image(AVFrame *pFrameRGB, int frame_count, int compare_with_first,
 		pthread_join(thread_optical_flow, NULL);
 		assert(!result_code);
 		printf("thread has ended.\n");
+		flow->frame_counter++;
+
+		if (shm_ring != NULL && flow->warm_up == false) {
+			write_shm_ring(shm_ring, frame_count, flow);
+		}
+		if (flow_stream != NULL && flow->warm_up == false) {
+			// pts of frame in microseconds (AV_NOPTS_VALUE === FLOW_STREAM_NO_PTS)
+			write_flow_stream(flow_stream, frame_count, pFrameRGB->pts, flow);
+		}
 
 	}
 
 	
 
-	if (verbose & VERBOSE_IMAGE) {
-		draw_crosshair(gui_image);
-		// save frame as a JPEG file
-		char file_name[MAX_FNAME_LEN];
-		sprintf(file_name, "/tmp/image_%04d.jpeg", frame_count);
-		int ret;
-		ret = storeJpegImageFile(gui_image, file_name);
-		if (ret != 0) printf("error store jpeg file");
+	int save_image = ((verbose & VERBOSE_IMAGE) && flow->warm_up == false);
+	if (save_image) {
+		draw_crosshair(draw_image);
 	}
 
 	if (verbose & VERBOSE_VIDEO) {
-		render_loop (gui_image, video_texture);
+		// displayed by main thread (owner of OpenGL context) at display rate
+		(void)video_texture; // texture updated by display loop (see gui_display_loop)
+		if (gpu_colorize) {
+			gui_publish_flow (display_image, (old_image != NULL) ? flow : NULL);
+		} else {
+			gui_publish_image (draw_image, (old_image != NULL) ? flow : NULL);
+		}
+		if (verbose & VERBOSE_STEP_BY_STEP) gui_wait_step();
+	}
+
+	if (preview && old_image != NULL) {
+		mjpeg_server_submit(mjpeg_server, draw_image); // copied (if time of next preview frame came)
+	}
+
+	if (!save_image && video_writer == NULL && draw_image != NULL) {
+		// drawn only for window or preview
+		free(draw_image->lpData);
+		free(draw_image);
+		draw_image = NULL;
+	}
+
+	if (flow->warm_up == false) {
+		// event mode: outputs written only during motion (and pre-roll, post-roll)
+		int record = (event_recorder == NULL) || event_recorder_update(event_recorder, frame_count, flow, old_image != NULL);
+		flow->recording = record;
+		if (record) {
+			EVENT_FRAME pre_roll;
+			while (event_recorder != NULL && event_recorder_pop(event_recorder, &pre_roll) == 0) {
+				OPTICAL_FLOW pre_roll_flow = *flow;
+				pre_roll_flow.array = pre_roll.array;
+				pre_roll_flow.frame_distance = pre_roll.frame_distance;
+				save_outputs(pre_roll.frame_count, pre_roll.time, pre_roll.image, save_image, (pre_roll.array != NULL) ? &pre_roll_flow : NULL);
+				free(pre_roll.array);
+			}
+			save_outputs(frame_count, pFrameRGB->pts, draw_image, save_image, (old_image != NULL) ? flow : NULL);
+		} else {
+			event_recorder_push(event_recorder, frame_count, pFrameRGB->pts, draw_image, // image owned by recorder
+					    (old_image != NULL && flow_file != NULL) ? flow : NULL);
+		}
+		draw_image = NULL;
 	}
 
 
 
-	if (verbose != VERBOSE_NO) {
-		free(gui_image->lpData);
-		free(gui_image);
+	if (draw_image != NULL) {
+		free(draw_image->lpData);
+		free(draw_image);
 	}
 
-	if (old_image != NULL && compare_with_first != true) {
-		free(old_image->lpData);
-		free(old_image);
+	if (display_image != raw_image) {
+		free(display_image->lpData);
+		free(display_image);
 	}
 
 	if (compare_with_first == false ||
 	    (compare_with_first == true && frame_count == 1)) {
-		old_image = raw_image;
-		old_image->lpData = raw_image->lpData;
+		// replaced old image: buffer for next frame
+		flow->spare_image = old_image;
+		flow->old_image = raw_image;
+	} else {
+		// first image stay as old image
+		flow->spare_image = raw_image;
 	}
 
 	fflush(stderr);
@@ -19,7 +19,12 @@
 
 struct imgRawImage* loadJpegImage(const void *jpg_buffer, int jpg_size);
 int storeJpegImageFile(struct imgRawImage* lpImage, char* lpFilename);
-void process_image(AVFrame *pFrameRGB, int frame_count, int compare_with_first, int verbose, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow);
+int storeJpegImageFileQuality(struct imgRawImage* lpImage, char* lpFilename, int quality, int fast_dct);
+int encodeJpegImageMemory(struct imgRawImage* lpImage, int quality, int flip, unsigned char **buffer, unsigned long *size);
+struct imgRawImage* frame_to_image(AVFrame *pFrameRGB, int num_components);
+struct imgRawImage* frame_into_image(AVFrame *pFrameRGB, int num_components, struct imgRawImage* image);
+struct imgRawImage* copy_image(struct imgRawImage* image);
+void process_image(AVFrame *pFrameRGB, AVFrame *pFrameDisplay, int frame_count, int compare_with_first, int verbose, unsigned int video_texture, int num_components, OPTICAL_FLOW* flow);
 long long int coord_to_raw_chunk(struct imgRawImage* image, COORD_2DU coord);
 struct coord_2Du raw_chunk_to_coord(struct imgRawImage* image, unsigned long int r);
 
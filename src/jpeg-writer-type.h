@@ -0,0 +1,54 @@
+/** \file
+   jpeg-writer-type.h --- header for jpeg-writer.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef JPEG_WRITER_TYPE_H
+#define JPEG_WRITER_TYPE_H
+
+#include <pthread.h>
+
+#include "image-type.h"
+
+#define JPEG_WRITER_FNAME_LEN 128
+
+// what to do if queue full (writers slower than processing)
+enum jpeg_queue_policy {
+	JPEG_QUEUE_BLOCK,       // backpressure: wait for free place (no lost images)
+	JPEG_QUEUE_DROP_NEWEST, // not save new image
+	JPEG_QUEUE_DROP_OLDEST  // replace oldest not saved image
+};
+
+typedef struct jpeg_job {
+	struct imgRawImage* image; // owned by queue
+	char file_name[JPEG_WRITER_FNAME_LEN];
+} JPEG_JOB;
+
+typedef struct jpeg_writer {
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+
+	JPEG_JOB* queue;  // ring buffer
+	int capacity;
+	int head;         // oldest job
+	int count;
+	int closed;
+
+	int policy;
+	int quality;      // 0..100
+	int fast_dct;     // JDCT_IFAST: faster, less accurate
+
+	int threads_num;
+	pthread_t* threads;
+
+	unsigned long int written;
+	unsigned long int dropped;
+	unsigned long int failed;
+} JPEG_WRITER;
+
+#endif /* JPEG_WRITER_TYPE_H */
@@ -0,0 +1,215 @@
+/** \file
+jpeg-writer.c --- save JPEG images by background threads
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: jpeg writer queue thread pool
+
+Usage:
+    init_jpeg_writer()     start threads
+    jpeg_writer_submit()   give image (ownership) and file name to queue, not wait for compression and disk
+    close_jpeg_writer()    save all queued images, stop threads
+
+    Bounded queue: if writers slower than processing, then (by policy)
+    processing wait for free place, or new image dropped, or oldest
+    not saved image replaced by new.
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "const.h"
+#include "jpeg-writer.h"
+#include "image.h"
+
+
+
+/**
+   \return -1 if name unknown
+*/
+int get_jpeg_queue_policy (char *name)
+{
+	if (strcmp(name, "block") == 0) return JPEG_QUEUE_BLOCK;
+	if (strcmp(name, "drop-new") == 0) return JPEG_QUEUE_DROP_NEWEST;
+	if (strcmp(name, "drop-old") == 0) return JPEG_QUEUE_DROP_OLDEST;
+	return -1;
+}
+
+
+
+int init_jpeg_writer (JPEG_WRITER* writer, int threads_num, int capacity, int policy, int quality, int fast_dct)
+{
+	writer->capacity = (capacity > 0) ? capacity : 1;
+	writer->queue = (JPEG_JOB*) calloc(writer->capacity, sizeof(JPEG_JOB));
+	writer->threads_num = (threads_num > 0) ? threads_num : 1;
+	writer->threads = (pthread_t*) calloc(writer->threads_num, sizeof(pthread_t));
+	if (writer->queue == NULL || writer->threads == NULL) {
+		printf("failed to allocated memory for jpeg writer\n");
+		free(writer->queue);
+		free(writer->threads);
+		return -1;
+	}
+	writer->head = 0;
+	writer->count = 0;
+	writer->closed = false;
+	writer->policy = policy;
+	writer->quality = quality;
+	writer->fast_dct = fast_dct;
+	writer->written = 0;
+	writer->dropped = 0;
+	writer->failed = 0;
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->not_empty, NULL);
+	pthread_cond_init(&writer->not_full, NULL);
+
+	for (int i = 0; i < writer->threads_num; i++) {
+		if (pthread_create(&writer->threads[i], NULL, jpeg_writer_thread, writer) != 0) {
+			printf("jpeg writer: can not create thread\n");
+			writer->threads_num = i;
+			break;
+		}
+	}
+	if (writer->threads_num == 0) {
+		free(writer->queue);
+		free(writer->threads);
+		return -1;
+	}
+
+	printf("jpeg writer: %d threads, queue %d, quality %d%s\n",
+	       writer->threads_num, writer->capacity, writer->quality, writer->fast_dct ? ", fast DCT" : "");
+	return 0;
+}
+
+
+
+static void free_image (struct imgRawImage* image)
+{
+	free(image->lpData);
+	free(image);
+}
+
+
+
+/**
+   Queue take ownership of image (freed after save or drop)
+*/
+void jpeg_writer_submit (JPEG_WRITER* writer, struct imgRawImage* image, char *file_name)
+{
+	pthread_mutex_lock(&writer->mutex);
+
+	if (writer->count == writer->capacity) {
+		switch (writer->policy) {
+		case JPEG_QUEUE_DROP_NEWEST:
+			writer->dropped++;
+			pthread_mutex_unlock(&writer->mutex);
+			free_image(image);
+			return;
+		case JPEG_QUEUE_DROP_OLDEST:
+			free_image(writer->queue[writer->head].image);
+			writer->head = (writer->head + 1) % writer->capacity;
+			writer->count--;
+			writer->dropped++;
+			break;
+		default: // JPEG_QUEUE_BLOCK
+			while (writer->count == writer->capacity) {
+				pthread_cond_wait(&writer->not_full, &writer->mutex);
+			}
+		}
+	}
+
+	JPEG_JOB* job = &writer->queue[(writer->head + writer->count) % writer->capacity];
+	job->image = image;
+	snprintf(job->file_name, sizeof(job->file_name), "%s", file_name);
+	writer->count++;
+
+	pthread_cond_signal(&writer->not_empty);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+
+
+void *jpeg_writer_thread (void *vin)
+{
+	JPEG_WRITER* writer = (JPEG_WRITER*) vin;
+
+	for (;;) {
+		pthread_mutex_lock(&writer->mutex);
+		while (writer->count == 0 && !writer->closed) {
+			pthread_cond_wait(&writer->not_empty, &writer->mutex);
+		}
+		if (writer->count == 0) { // closed and empty
+			pthread_mutex_unlock(&writer->mutex);
+			break;
+		}
+		JPEG_JOB job = writer->queue[writer->head];
+		writer->head = (writer->head + 1) % writer->capacity;
+		writer->count--;
+		pthread_cond_signal(&writer->not_full);
+		pthread_mutex_unlock(&writer->mutex);
+
+		// compression and disk i/o without lock
+		int ret = storeJpegImageFileQuality(job.image, job.file_name, writer->quality, writer->fast_dct);
+		free_image(job.image);
+
+		pthread_mutex_lock(&writer->mutex);
+		if (ret == 0) {
+			writer->written++;
+		} else {
+			writer->failed++;
+		}
+		pthread_mutex_unlock(&writer->mutex);
+	}
+
+	return NULL;
+}
+
+
+
+/**
+   Save all queued images and stop threads
+*/
+void close_jpeg_writer (JPEG_WRITER* writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+	writer->closed = true;
+	pthread_cond_broadcast(&writer->not_empty);
+	pthread_mutex_unlock(&writer->mutex);
+
+	for (int i = 0; i < writer->threads_num; i++) {
+		pthread_join(writer->threads[i], NULL);
+	}
+
+	printf("jpeg writer: written %lu, dropped %lu, failed %lu\n", writer->written, writer->dropped, writer->failed);
+
+	pthread_cond_destroy(&writer->not_full);
+	pthread_cond_destroy(&writer->not_empty);
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer->queue);
+	free(writer->threads);
+}
@@ -0,0 +1,21 @@
+/** \file
+   jpeg-writer.h --- header for jpeg-writer.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef JPEG_WRITER_H
+#define JPEG_WRITER_H
+
+#include "jpeg-writer-type.h"
+
+int get_jpeg_queue_policy (char *name);
+int init_jpeg_writer (JPEG_WRITER* writer, int threads_num, int capacity, int policy, int quality, int fast_dct);
+void jpeg_writer_submit (JPEG_WRITER* writer, struct imgRawImage* image, char *file_name);
+void *jpeg_writer_thread (void *vin);
+void close_jpeg_writer (JPEG_WRITER* writer);
+
+#endif /* JPEG_WRITER_H */
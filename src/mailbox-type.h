@@ -0,0 +1,28 @@
+/** \file
+   mailbox-type.h --- header for mailbox.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef MAILBOX_TYPE_H
+#define MAILBOX_TYPE_H
+
+#include <pthread.h>
+#include <libavutil/frame.h>
+
+typedef struct frame_mailbox {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	AVFrame* frame; // single slot: only latest frame
+	int full;
+	int closed;     // producer finished (end of stream, error or stop)
+
+	unsigned long int published;
+	unsigned long int dropped; // overwritten before consumer take it
+} FRAME_MAILBOX;
+
+#endif /* MAILBOX_TYPE_H */
@@ -0,0 +1,127 @@
+/** \file
+mailbox.c --- single slot "latest frame wins" mailbox between threads
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: mailbox latest frame thread
+
+Usage:
+    producer (capture thread):  mailbox_publish() for every decoded frame, mailbox_close() at the end
+    consumer (processing):      while (mailbox_take() == 0) {process; av_frame_unref();}
+
+    If consumer is slower than producer, then not taken frame replaced by
+    newer one (and counted as dropped), so consumer always work with
+    freshest frame and latency not grow.
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "const.h"
+#include "mailbox.h"
+
+
+
+int init_mailbox (FRAME_MAILBOX* mailbox)
+{
+	mailbox->frame = av_frame_alloc();
+	if (!mailbox->frame) {
+		printf("failed to allocated memory for mailbox AVFrame\n");
+		return -1;
+	}
+	mailbox->full = false;
+	mailbox->closed = false;
+	mailbox->published = 0;
+	mailbox->dropped = 0;
+
+	pthread_mutex_init(&mailbox->mutex, NULL);
+	pthread_cond_init(&mailbox->cond, NULL);
+	return 0;
+}
+
+
+
+void free_mailbox (FRAME_MAILBOX* mailbox)
+{
+	av_frame_free(&mailbox->frame);
+	pthread_cond_destroy(&mailbox->cond);
+	pthread_mutex_destroy(&mailbox->mutex);
+}
+
+
+
+/**
+   Move frame reference into mailbox (frame become empty).
+   Not taken previous frame is dropped.
+*/
+void mailbox_publish (FRAME_MAILBOX* mailbox, AVFrame* frame)
+{
+	pthread_mutex_lock(&mailbox->mutex);
+	if (mailbox->full) {
+		av_frame_unref(mailbox->frame);
+		mailbox->dropped++;
+	}
+	av_frame_move_ref(mailbox->frame, frame);
+	mailbox->full = true;
+	mailbox->published++;
+	pthread_cond_signal(&mailbox->cond);
+	pthread_mutex_unlock(&mailbox->mutex);
+}
+
+
+
+/**
+   Wait for frame and move its reference from mailbox into (empty) frame.
+
+   \return 0 if frame taken; -1 if mailbox closed and empty
+*/
+int mailbox_take (FRAME_MAILBOX* mailbox, AVFrame* frame)
+{
+	int result = -1;
+
+	pthread_mutex_lock(&mailbox->mutex);
+	while (!mailbox->full && !mailbox->closed) {
+		pthread_cond_wait(&mailbox->cond, &mailbox->mutex);
+	}
+	if (mailbox->full) {
+		av_frame_move_ref(frame, mailbox->frame);
+		mailbox->full = false;
+		result = 0;
+	}
+	pthread_mutex_unlock(&mailbox->mutex);
+	return result;
+}
+
+
+
+void mailbox_close (FRAME_MAILBOX* mailbox)
+{
+	pthread_mutex_lock(&mailbox->mutex);
+	mailbox->closed = true;
+	pthread_cond_broadcast(&mailbox->cond);
+	pthread_mutex_unlock(&mailbox->mutex);
+}
@@ -0,0 +1,21 @@
+/** \file
+   mailbox.h --- header for mailbox.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include "mailbox-type.h"
+
+int init_mailbox (FRAME_MAILBOX* mailbox);
+void free_mailbox (FRAME_MAILBOX* mailbox);
+void mailbox_publish (FRAME_MAILBOX* mailbox, AVFrame* frame);
+int mailbox_take (FRAME_MAILBOX* mailbox, AVFrame* frame);
+void mailbox_close (FRAME_MAILBOX* mailbox);
+
+#endif /* MAILBOX_H */
@@ -33,23 +33,82 @@ Code:
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <getopt.h>          /* getopt_long() */
 #include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "const.h"
 #include "capture.h"
+#include "raw-input.h"
+#include "v4l2-capture.h"
+#include "segments.h"
+#include "jpeg-writer.h"
+#include "video-writer.h"
+#include "flow-file.h"
+#include "shm-ring.h"
+#include "flow-stream.h"
+#include "mjpeg-server.h"
+#include "event-recorder.h"
 #include "gui.h"
 #include "block-matching.h"
 #include "main.h"
 
 
 
-static const char short_options[] = "d:hoyn:v:f";
+static const char short_options[] = "d:hoyn:v:ft:s:a:";
+
+enum long_only_options {
+	OPT_THREAD_TYPE = 0x100, // outside of char range
+	OPT_LOW_DELAY,
+	OPT_CAPTURE_THREAD,
+	OPT_PROBESIZE,
+	OPT_ANALYZEDURATION,
+	OPT_NOBUFFER,
+	OPT_RTSP_TRANSPORT,
+	OPT_SKIP_PROBE,
+	OPT_EVERY,
+	OPT_TIME_STRIDE,
+	OPT_KEYFRAMES,
+	OPT_CODEC_MV,
+	OPT_RAW,
+	OPT_BENCHMARK,
+	OPT_V4L2,
+	OPT_SEGMENTS,
+	OPT_JPEG_QUALITY,
+	OPT_JPEG_FAST,
+	OPT_JPEG_THREADS,
+	OPT_JPEG_QUEUE,
+	OPT_JPEG_POLICY,
+	OPT_VIDEO_OUT,
+	OPT_VIDEO_CODEC,
+	OPT_VIDEO_FPS,
+	OPT_FLOW_OUT,
+	OPT_FLOW_INT8,
+	OPT_FLOW_COST,
+	OPT_FLOW_AGE,
+	OPT_SHM,
+	OPT_SHM_LUMA,
+	OPT_SHM_SLOTS,
+	OPT_OUTPUT_SPARSE,
+	OPT_OUTPUT_STATS,
+	OPT_MJPEG,
+	OPT_MJPEG_FPS,
+	OPT_MJPEG_QUALITY,
+	OPT_EVENT,
+	OPT_EVENT_PRE,
+	OPT_EVENT_POST,
+	OPT_SEARCH,
+	OPT_GLOBAL_MOTION,
+	OPT_QUADTREE
+};
 
 static const struct option
 long_options[] = {
         // english alphabet:  abcdefghijklmnopqrstuvwxyz.
-        // used                  x   x     xx      x  x .
+        // used                 xx   x     xx     xxx x .
         { "device",             required_argument, NULL, 'd' },
         { "help",               no_argument,       NULL, 'h' },
         { "output",             no_argument,       NULL, 'o' },
@@ -57,6 +116,51 @@ long_options[] = {
         { "numframes",          required_argument, NULL, 'n' },
         { "verbose",            required_argument, NULL, 'v' },
         { "first",              no_argument,       NULL, 'f' },
+        { "threads",            required_argument, NULL, 't' },
+        { "thread-type",        required_argument, NULL, OPT_THREAD_TYPE },
+        { "low-delay",          required_argument, NULL, OPT_LOW_DELAY },
+        { "capture-thread",     required_argument, NULL, OPT_CAPTURE_THREAD },
+        { "probesize",          required_argument, NULL, OPT_PROBESIZE },
+        { "analyzeduration",    required_argument, NULL, OPT_ANALYZEDURATION },
+        { "nobuffer",           no_argument,       NULL, OPT_NOBUFFER },
+        { "rtsp-transport",     required_argument, NULL, OPT_RTSP_TRANSPORT },
+        { "skip-probe",         no_argument,       NULL, OPT_SKIP_PROBE },
+        { "size",               required_argument, NULL, 's' },
+        { "analysis-scale",     required_argument, NULL, 'a' },
+        { "every",              required_argument, NULL, OPT_EVERY },
+        { "time-stride",        required_argument, NULL, OPT_TIME_STRIDE },
+        { "keyframes",          no_argument,       NULL, OPT_KEYFRAMES },
+        { "codec-mv",           optional_argument, NULL, OPT_CODEC_MV },
+        { "raw",                required_argument, NULL, OPT_RAW },
+        { "benchmark",          no_argument,       NULL, OPT_BENCHMARK },
+        { "v4l2",               required_argument, NULL, OPT_V4L2 },
+        { "segments",           required_argument, NULL, OPT_SEGMENTS },
+        { "jpeg-quality",       required_argument, NULL, OPT_JPEG_QUALITY },
+        { "jpeg-fast",          no_argument,       NULL, OPT_JPEG_FAST },
+        { "jpeg-threads",       required_argument, NULL, OPT_JPEG_THREADS },
+        { "jpeg-queue",         required_argument, NULL, OPT_JPEG_QUEUE },
+        { "jpeg-policy",        required_argument, NULL, OPT_JPEG_POLICY },
+        { "video-out",          required_argument, NULL, OPT_VIDEO_OUT },
+        { "video-codec",        required_argument, NULL, OPT_VIDEO_CODEC },
+        { "video-fps",          required_argument, NULL, OPT_VIDEO_FPS },
+        { "flow-out",           required_argument, NULL, OPT_FLOW_OUT },
+        { "flow-int8",          no_argument,       NULL, OPT_FLOW_INT8 },
+        { "flow-cost",          no_argument,       NULL, OPT_FLOW_COST },
+        { "flow-age",           no_argument,       NULL, OPT_FLOW_AGE },
+        { "shm",                optional_argument, NULL, OPT_SHM },
+        { "shm-luma",           no_argument,       NULL, OPT_SHM_LUMA },
+        { "shm-slots",          required_argument, NULL, OPT_SHM_SLOTS },
+        { "output-sparse",      no_argument,       NULL, OPT_OUTPUT_SPARSE },
+        { "output-stats",       no_argument,       NULL, OPT_OUTPUT_STATS },
+        { "mjpeg",              required_argument, NULL, OPT_MJPEG },
+        { "mjpeg-fps",          required_argument, NULL, OPT_MJPEG_FPS },
+        { "mjpeg-quality",      required_argument, NULL, OPT_MJPEG_QUALITY },
+        { "event",              required_argument, NULL, OPT_EVENT },
+        { "event-pre",          required_argument, NULL, OPT_EVENT_PRE },
+        { "event-post",         required_argument, NULL, OPT_EVENT_POST },
+        { "search",             required_argument, NULL, OPT_SEARCH },
+        { "global-motion",      no_argument,       NULL, OPT_GLOBAL_MOTION },
+        { "quadtree",           optional_argument, NULL, OPT_QUADTREE },
         { 0, 0, 0, 0 }
 };
 
@@ -70,8 +174,9 @@ void usage(FILE *fp, char **argv, char *dev_name, int frame_count)
                 "Options:\n"
                 "-d | --device name             Video device name [%s]\n"
                 "-h | --help                    Print this message\n"
-                "-o | --output                  Outputs stream to stdout\n"
-                "-y | --yuyv                    Force format to 640x480 YUYV\n"
+                "-o | --output                  Stream flow of every frame to stdout (length-prefixed binary records,\n"
+                "\t\t\tsee flow-stream-type.h), messages moved to stderr\n"
+                "-y | --yuyv                    Force format to 640x480 YUYV (capture by V4L2 without libav, size can be changed by --size)\n"
                 "-n | --numframes               Number of frames to grab [current value = %i].\n"
                 "\t\t\tIf \"n\" not specified, or \"n\" less than 1 (zero or negative),\n"
                 "\t\t\t then loop will continue infinity\n"
@@ -80,6 +185,74 @@ void usage(FILE *fp, char **argv, char *dev_name, int frame_count)
                 "\t\t\t'-v 2' 0x02=b00000010 add video;\n"
                 "\t\t\t'-v 4' 0x04=b00000100 add step by step      (you can ON this function by press 'space')\n"
                 "\t\t\tso -v 6: mean verbose level 0x06=b00000110 that equal to both video and step_by_step\n"
+                "-t | --threads n               Decoder threads [0 === one thread per core]\n"
+                "     --thread-type type        Decoder threading: 'frame' or 'slice'\n"
+                "\t\t\t[default: 'slice' for live input (camera, rtsp), 'frame' for files]\n"
+                "     --low-delay 0|1           Decoder low delay flag [default: 1 for live input, 0 for files]\n"
+                "     --capture-thread 0|1      Decode in separate thread and process only latest frame,\n"
+                "\t\t\tframes decoded during processing are dropped [default: 1 for live input, 0 for files]\n"
+                "     --probesize bytes         Demuxer probe size (less === faster start of network stream)\n"
+                "     --analyzeduration us      Demuxer analyze duration in microseconds\n"
+                "     --nobuffer                Not buffer packets on start of stream (fflags nobuffer)\n"
+                "     --rtsp-transport name     RTSP transport: 'tcp', 'udp', 'udp_multicast', 'http'\n"
+                "     --skip-probe              Not read stream for find stream info:\n"
+                "\t\t\tuse parameters from header (and --size), fast start and reconnect\n"
+                "-s | --size WxH                Known frame size of source, for example 1920x1080\n"
+                "-a | --analysis-scale n        Calculate optical flow on frame reduced in n times [1 === full resolution],\n"
+                "\t\t\tresult drawn on full resolution frame\n"
+                "     --every n                 Process every n-th decoded frame\n"
+                "     --time-stride seconds     Process one frame per time stride\n"
+                "     --keyframes               Decode and process keyframes only\n"
+                "\t\t\tsearch range grow with distance between processed frames\n"
+                "     --codec-mv[=radius]       Start block search from motion vectors of codec (H.264, HEVC, ...),\n"
+                "\t\t\tsearch only in small radius (0..%d) around them [default radius = %d]\n"
+                "     --search full|epzs        Block search: 'full' (all shifts in window) or 'epzs' (predictive:\n"
+                "\t\t\tshifts of neighbours and previous frame, then small pattern) [default: full]\n"
+                "     --global-motion           Estimate motion of camera (shake, pan) for every frame and search blocks\n"
+                "\t\t\taround it, residual local motion reported separately\n"
+                "     --quadtree[=size]         Adaptive block size: static and uniform motion areas searched by large blocks,\n"
+                "\t\t\tsplit down to %d pixels on motion boundaries and high cost [default size = %d]\n"
+                "     --raw gray|rgb|y4m        Read raw frames (need --size) or YUV4MPEG2 stream without decoder,\n"
+                "\t\t\tfile memory mapped, '-d -' === stdin [default: y4m for *.y4m files and stdin]\n"
+                "     --benchmark               Raw input: match every block of every frame without time bound and outputs,\n"
+                "\t\t\tprint blocks and cost evaluations per second of matching\n"
+                "     --v4l2 auto|yuyv|grey     Capture from camera by V4L2 memory mapped buffers without libav,\n"
+                "\t\t\tonly luma used ('auto' === grey if camera support it, else yuyv) [default size: 640x480]\n"
+                "     --segments n              Process video file by n parallel segments (0 === one per core),\n"
+                "\t\t\tper-frame results printed in order; without GUI (-v 2, -v 4), -n and -f not used\n",
+                argv[0], dev_name, frame_count, OPTICAL_FLOW_MAX_SHIFT_LOCAL_LIMIT, OPTICAL_FLOW_SEED_RADIUS,
+                OPTICAL_FLOW_BLOCK_SIZE, OPTICAL_FLOW_QUADTREE_SIZE);
+        // output options (separate string: length of string literal limited)
+        fprintf(fp,
+                "     --jpeg-quality n          Quality of saved images (-v 1) [default: %d]\n"
+                "     --jpeg-fast               Fast (less accurate) DCT for saved images\n"
+                "     --jpeg-threads n          Save images by n background threads (0 === synchronously) [default: %d]\n"
+                "     --jpeg-queue n            Images waiting for save [default: %d]\n"
+                "     --jpeg-policy name        If queue full: 'block' (wait), 'drop-new', 'drop-old' [default: block]\n"
+                "     --video-out file          Encode drawn optical flow into video file (container by extension: .mp4, .mkv, ...)\n"
+                "\t\t\tby background thread, not used with --segments\n"
+                "     --video-codec name        Encoder of video output [default: codec of container, for example libx264]\n"
+                "     --video-fps n             Time base of video output (frames keep time of source) [default: %d]\n"
+                "     --flow-out file           Save shift of blocks for every frame into binary file with index\n"
+                "\t\t\t(format see in flow-file-type.h), not used with --segments\n"
+                "     --flow-int8               Store shift as int8 (saturated) instead of int16\n"
+                "     --flow-cost               Store cost (difference of blocks) plane\n"
+                "     --flow-age                Store age (frames since update of block) plane\n"
+                "     --shm[=name]              Export optical flow of every frame into POSIX shared memory ring\n"
+                "\t\t\tfor other processes (see shm-ring-type.h, ./shm_reader) [default name: %s]\n"
+                "     --shm-luma                Export luma of (analysis) frame too\n"
+                "     --shm-slots n             Frames in ring [default: %d]\n"
+                "     --output-sparse           Stream (-o) only moving blocks: coordinates and shift\n"
+                "     --output-stats            Stream (-o) only summary of frame: moving blocks, mean and dominant direction,\n"
+                "\t\t\thistogram of magnitude, bounding box of motion, stale blocks (64 bytes)\n"
+                "     --mjpeg [ip:]port         Headless preview: MJPEG over HTTP (/ === stream, /frame.jpeg === one frame),\n"
+                "\t\t\tencoded only while client connected [default ip: 127.0.0.1]\n"
+                "     --mjpeg-fps n             Max frame rate of preview [default: %d]\n"
+                "     --mjpeg-quality n         Quality of preview [default: %d]\n"
+                "     --event f                 Event mode: images, video and flow file written only while\n"
+                "\t\t\tfraction f (0..1) of blocks moving, not used with --segments\n"
+                "     --event-pre n             Frames written before start of motion (kept in memory) [default: %d]\n"
+                "     --event-post n            Frames written after end of motion [default: %d]\n"
                 "\n"
                 "\t\t\t1 variant\n"
                 "\t\t\tstatic coordinates:\n"
@@ -87,7 +260,33 @@ void usage(FILE *fp, char **argv, char *dev_name, int frame_count)
                 "\t\t\t2 variant\n"
                 "\t\t\tserver specified\n"
                 "\n",
-                argv[0], dev_name, frame_count);
+                JPEG_QUALITY, JPEG_WRITER_THREADS, JPEG_WRITER_QUEUE, OPTICAL_FLOW_FPS,
+                SHM_RING_NAME, SHM_RING_SLOTS, MJPEG_FPS, MJPEG_QUALITY,
+                EVENT_PRE_ROLL, EVENT_POST_ROLL);
+}
+
+
+
+/* capture and process all frames (source selected by options) */
+static void * processing_thread (void *arguments)
+{
+	extern int verbose;
+	MAINLOOP_ARGS *args = (MAINLOOP_ARGS *)arguments;
+	CAPTURE_OPTIONS *options = args->options;
+
+	if (args->raw_format != RAW_NONE) {
+		raw_mainloop(args->dev_name, args->raw_format, options->width, options->height, args->max_frame_count, args->compare_with_first, args->benchmark, args->video_texture);
+	} else if (args->force_format != V4L2_FORMAT_NONE) {
+		v4l2_mainloop(args->dev_name, args->force_format,
+			      (options->width > 0) ? options->width : V4L2_DEFAULT_WIDTH,
+			      (options->height > 0) ? options->height : V4L2_DEFAULT_HEIGHT,
+			      args->max_frame_count, args->compare_with_first, args->video_texture);
+	} else {
+		mainloop(args->dev_name, args->max_frame_count, args->compare_with_first, options, args->video_texture);
+	}
+
+	if (verbose & VERBOSE_VIDEO) gui_finish(); // display loop stop
+	return NULL;
 }
 
 
@@ -95,10 +294,52 @@ void usage(FILE *fp, char **argv, char *dev_name, int frame_count)
 int main (int argc, char **argv)
 {
 	char *dev_name = "/dev/video0";
-	int out_buf = 0;
-	int force_format = 0;
+	int out_buf = 0; // stream flow to stdout
+	int output_mode = FLOW_STREAM_DENSE;
+	char *mjpeg_address = NULL;
+	int mjpeg_fps = MJPEG_FPS;
+	int mjpeg_quality = MJPEG_QUALITY;
+	double event_threshold = -1.0; // < 0 === all frames written
+	int event_pre = EVENT_PRE_ROLL;
+	int event_post = EVENT_POST_ROLL;
+	int force_format = V4L2_FORMAT_NONE;
 	int max_frame_count = -1;
 	int compare_with_first = false;
+	int raw_format = RAW_NONE;
+	int benchmark = false;
+	int segments_num = -1; // -1 === sequential processing
+	int jpeg_quality = JPEG_QUALITY;
+	int jpeg_fast_dct = false;
+	int jpeg_threads = JPEG_WRITER_THREADS;
+	int jpeg_queue = JPEG_WRITER_QUEUE;
+	int jpeg_policy = JPEG_QUEUE_BLOCK;
+	char *video_out = NULL;
+	char *video_codec = NULL;
+	int video_fps = OPTICAL_FLOW_FPS;
+	char *flow_out = NULL;
+	uint32_t flow_flags = FLOW_FILE_INT16;
+	char *shm_name = NULL;
+	int shm_luma = false;
+	int shm_slots = SHM_RING_SLOTS;
+	CAPTURE_OPTIONS capture_options = {
+		.thread_count = 0,
+		.thread_type = CAPTURE_AUTO,
+		.low_delay = CAPTURE_AUTO,
+		.capture_thread = CAPTURE_AUTO,
+		.probesize = 0,
+		.analyzeduration = CAPTURE_AUTO,
+		.nobuffer = false,
+		.rtsp_transport = NULL,
+		.skip_probe = false,
+		.width = 0,
+		.height = 0,
+		.analysis_scale = 1,
+		.every = 1,
+		.time_stride = 0.0,
+		.keyframes_only = false,
+		.codec_mv = false,
+		.codec_mv_radius = OPTICAL_FLOW_SEED_RADIUS
+	};
 
 	unsigned int WINDOW_WIDTH = 640;
         unsigned int WINDOW_HEIGHT = 360;
@@ -130,7 +371,7 @@ int main (int argc, char **argv)
                         break;
 
                 case 'y':
-                        force_format++;
+                        force_format = V4L2_FORMAT_YUYV;
                         break;
 
                 case 'n':
@@ -150,6 +391,253 @@ int main (int argc, char **argv)
                         compare_with_first = true;
                         break;
 
+                case 't':
+                        errno = 0;
+                        capture_options.thread_count = strtol(optarg, NULL, 0);
+                        if (errno)
+                                printf("%s", optarg);
+                        break;
+
+                case OPT_THREAD_TYPE:
+                        if (strcmp(optarg, "frame") == 0) {
+                                capture_options.thread_type = FF_THREAD_FRAME;
+                        } else if (strcmp(optarg, "slice") == 0) {
+                                capture_options.thread_type = FF_THREAD_SLICE;
+                        } else {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_LOW_DELAY:
+                        capture_options.low_delay = (strtol(optarg, NULL, 0) != 0);
+                        break;
+
+                case OPT_CAPTURE_THREAD:
+                        capture_options.capture_thread = (strtol(optarg, NULL, 0) != 0);
+                        break;
+
+                case OPT_PROBESIZE:
+                        capture_options.probesize = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_ANALYZEDURATION:
+                        capture_options.analyzeduration = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_NOBUFFER:
+                        capture_options.nobuffer = true;
+                        break;
+
+                case OPT_RTSP_TRANSPORT:
+                        capture_options.rtsp_transport = optarg;
+                        break;
+
+                case OPT_SKIP_PROBE:
+                        capture_options.skip_probe = true;
+                        break;
+
+                case 'a':
+                        errno = 0;
+                        capture_options.analysis_scale = strtol(optarg, NULL, 0);
+                        if (errno || capture_options.analysis_scale < 1) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_EVERY:
+                        capture_options.every = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_TIME_STRIDE:
+                        capture_options.time_stride = strtod(optarg, NULL);
+                        break;
+
+                case OPT_KEYFRAMES:
+                        capture_options.keyframes_only = true;
+                        break;
+
+                case OPT_CODEC_MV:
+                        capture_options.codec_mv = true;
+                        if (optarg != NULL) {
+                                errno = 0;
+                                capture_options.codec_mv_radius = strtol(optarg, NULL, 0);
+                                if (errno || capture_options.codec_mv_radius < 0 ||
+                                    capture_options.codec_mv_radius > OPTICAL_FLOW_MAX_SHIFT_LOCAL_LIMIT) {
+                                        usage(stderr, argv, dev_name, max_frame_count);
+                                        exit(EXIT_FAILURE);
+                                }
+                        }
+                        break;
+
+                case OPT_SEARCH:
+                        if (strcmp(optarg, "full") == 0) {
+                                search_mode = SEARCH_FULL;
+                        } else if (strcmp(optarg, "epzs") == 0) {
+                                search_mode = SEARCH_EPZS;
+                        } else {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_GLOBAL_MOTION:
+                        global_motion = true;
+                        break;
+
+                case OPT_QUADTREE:
+                        quadtree_size = OPTICAL_FLOW_QUADTREE_SIZE;
+                        if (optarg != NULL)
+                                quadtree_size = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_RAW:
+                        raw_format = get_raw_format(optarg);
+                        if (raw_format == RAW_NONE) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_BENCHMARK:
+                        benchmark = true;
+                        break;
+
+                case OPT_V4L2:
+                        force_format = get_v4l2_format(optarg);
+                        if (force_format == V4L2_FORMAT_NONE) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_SEGMENTS:
+                        errno = 0;
+                        segments_num = strtol(optarg, NULL, 0);
+                        if (errno || segments_num < 0) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_JPEG_QUALITY:
+                        jpeg_quality = strtol(optarg, NULL, 0);
+                        if (jpeg_quality < 0 || jpeg_quality > 100) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_JPEG_FAST:
+                        jpeg_fast_dct = true;
+                        break;
+
+                case OPT_JPEG_THREADS:
+                        jpeg_threads = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_JPEG_QUEUE:
+                        jpeg_queue = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_JPEG_POLICY:
+                        jpeg_policy = get_jpeg_queue_policy(optarg);
+                        if (jpeg_policy < 0) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_VIDEO_OUT:
+                        video_out = optarg;
+                        break;
+
+                case OPT_VIDEO_CODEC:
+                        video_codec = optarg;
+                        break;
+
+                case OPT_VIDEO_FPS:
+                        video_fps = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_FLOW_OUT:
+                        flow_out = optarg;
+                        break;
+
+                case OPT_FLOW_INT8:
+                        flow_flags &= ~FLOW_FILE_INT16;
+                        break;
+
+                case OPT_FLOW_COST:
+                        flow_flags |= FLOW_FILE_COST;
+                        break;
+
+                case OPT_FLOW_AGE:
+                        flow_flags |= FLOW_FILE_AGE;
+                        break;
+
+                case OPT_SHM:
+                        shm_name = (optarg != NULL) ? optarg : SHM_RING_NAME;
+                        break;
+
+                case OPT_SHM_LUMA:
+                        shm_luma = true;
+                        break;
+
+                case OPT_SHM_SLOTS:
+                        shm_slots = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_OUTPUT_SPARSE:
+                        out_buf++;
+                        output_mode = FLOW_STREAM_SPARSE;
+                        break;
+
+                case OPT_OUTPUT_STATS:
+                        out_buf++;
+                        output_mode = FLOW_STREAM_STATS;
+                        break;
+
+                case OPT_MJPEG:
+                        mjpeg_address = optarg;
+                        break;
+
+                case OPT_MJPEG_FPS:
+                        mjpeg_fps = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_MJPEG_QUALITY:
+                        mjpeg_quality = strtol(optarg, NULL, 0);
+                        if (mjpeg_quality < 0 || mjpeg_quality > 100) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_EVENT:
+                        event_threshold = strtod(optarg, NULL);
+                        if (event_threshold < 0.0 || event_threshold > 1.0) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case OPT_EVENT_PRE:
+                        event_pre = strtol(optarg, NULL, 0);
+                        break;
+
+                case OPT_EVENT_POST:
+                        event_post = strtol(optarg, NULL, 0);
+                        break;
+
+                case 's':
+                        if (sscanf(optarg, "%dx%d", &capture_options.width, &capture_options.height) != 2) {
+                                usage(stderr, argv, dev_name, max_frame_count);
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
                 default:
                         usage(stderr, argv, dev_name, max_frame_count);
                         exit(EXIT_FAILURE);
@@ -157,6 +645,80 @@ int main (int argc, char **argv)
         }
 
 
+	srandom((unsigned int)time(NULL));
+
+	// stdout owned by stream of records: all messages (printf) moved to stderr
+	FLOW_STREAM stream_flow;
+	if (out_buf && segments_num < 0) {
+		int fd = dup(STDOUT_FILENO);
+		fflush(stdout);
+		if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+			fprintf(stderr, "ERROR could not redirect stdout\n");
+			exit(EXIT_FAILURE);
+		}
+		signal(SIGPIPE, SIG_IGN); // reader closed pipe: write() return EPIPE, processing continue
+		if (init_flow_stream(&stream_flow, fd, output_mode) == 0) {
+			flow_stream = &stream_flow;
+		}
+	}
+
+	// compression and disk i/o of saved images not stop processing
+	JPEG_WRITER writer_jpeg;
+	if ((verbose & VERBOSE_IMAGE) && jpeg_threads > 0 &&
+	    init_jpeg_writer(&writer_jpeg, jpeg_threads, jpeg_queue, jpeg_policy, jpeg_quality, jpeg_fast_dct) == 0) {
+		jpeg_writer = &writer_jpeg;
+	}
+
+	if (segments_num >= 0) {
+		// segments processed in parallel: one window (or video file) can not show all of them
+		verbose &= ~(VERBOSE_VIDEO | VERBOSE_STEP_BY_STEP);
+		if (video_out != NULL) printf("video output not used with segments\n");
+		if (flow_out != NULL) printf("flow file not used with segments\n");
+		if (shm_name != NULL) printf("shared memory not used with segments\n");
+		if (out_buf) printf("output stream not used with segments (results printed to stdout)\n");
+		if (mjpeg_address != NULL) printf("preview not used with segments\n");
+		if (event_threshold >= 0.0) printf("event mode not used with segments\n");
+		int result = segments_mainloop(dev_name, segments_num, &capture_options);
+		if (jpeg_writer != NULL) close_jpeg_writer(jpeg_writer);
+		return result;
+	}
+
+
+	VIDEO_WRITER writer_video;
+	if (video_out != NULL &&
+	    init_video_writer(&writer_video, video_out, video_codec, video_fps, VIDEO_WRITER_QUEUE) == 0) {
+		video_writer = &writer_video;
+	}
+
+
+	FLOW_FILE file_flow;
+	if (flow_out != NULL &&
+	    init_flow_file(&file_flow, flow_out, flow_flags) == 0) {
+		flow_file = &file_flow;
+	}
+
+
+	SHM_RING ring_shm;
+	if (shm_name != NULL &&
+	    init_shm_ring(&ring_shm, shm_name, shm_slots, shm_luma) == 0) {
+		shm_ring = &ring_shm;
+	}
+
+
+	MJPEG_SERVER server_mjpeg;
+	if (mjpeg_address != NULL &&
+	    init_mjpeg_server(&server_mjpeg, mjpeg_address, mjpeg_fps, mjpeg_quality) == 0) {
+		mjpeg_server = &server_mjpeg;
+	}
+
+
+	EVENT_RECORDER recorder_event;
+	if (event_threshold >= 0.0 &&
+	    init_event_recorder(&recorder_event, event_threshold, event_pre, event_post) == 0) {
+		event_recorder = &recorder_event;
+	}
+
+
 	// init gui: OpenGL(glfw)
         if (verbose & VERBOSE_VIDEO) {
                 int ret = init_gui(WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -165,8 +727,45 @@ int main (int argc, char **argv)
         }
 
 
-	srandom((unsigned int)time(NULL));
-
-	mainloop(dev_name, max_frame_count, compare_with_first, video_texture);
+	size_t dev_name_len = strlen(dev_name);
+	if (raw_format == RAW_NONE && dev_name_len > 4 && strcmp(dev_name + dev_name_len - 4, ".y4m") == 0) {
+		raw_format = RAW_Y4M;
+	}
+	if (raw_format == RAW_NONE && strcmp(dev_name, "-") == 0) {
+		raw_format = RAW_Y4M; // stdin not opened by libav: only Y4M stream (or --raw gray|rgb)
+	}
+
+	MAINLOOP_ARGS mainloop_args = {
+		.dev_name = dev_name,
+		.raw_format = raw_format,
+		.force_format = force_format,
+		.max_frame_count = max_frame_count,
+		.compare_with_first = compare_with_first,
+		.benchmark = benchmark,
+		.options = &capture_options,
+		.video_texture = video_texture
+	};
+
+	if (verbose & VERBOSE_VIDEO) {
+		// GLFW events only in main thread: display here, capture and processing in other thread
+		pthread_t processing;
+		if (pthread_create(&processing, NULL, processing_thread, &mainloop_args) != 0) {
+			printf("ERROR could not create processing thread\n");
+			return -1;
+		}
+		gui_display_loop(video_texture);
+		pthread_join(processing, NULL);
+		deallocate_resources();
+	} else {
+		processing_thread(&mainloop_args);
+	}
+
+	if (event_recorder != NULL) close_event_recorder(event_recorder);
+	if (mjpeg_server != NULL) close_mjpeg_server(mjpeg_server);
+	if (flow_stream != NULL) close_flow_stream(flow_stream);
+	if (shm_ring != NULL) close_shm_ring(shm_ring);
+	if (flow_file != NULL) close_flow_file(flow_file);
+	if (video_writer != NULL) close_video_writer(video_writer);
+	if (jpeg_writer != NULL) close_jpeg_writer(jpeg_writer);
 	return 0;
 }
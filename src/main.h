@@ -17,10 +17,16 @@ struct imgRawImage* raw_image;
 struct imgRawImage* gui_image;
 struct imgRawImage* old_image;
 int verbose = VERBOSE_NO;
-int hide_static_block = true;
+_Atomic int hide_static_block = true; // toggled by display thread (key)
+int search_mode = SEARCH_FULL; // see block-matching-type.h
+int global_motion = false; // estimate camera ego-motion of every frame
+int quadtree_size = 0; // root of adaptive partition in pixels, 0 === uniform grid of blocks
 GLFWwindow* window;
 unsigned int shaderProgram_video;
 unsigned int shaderProgram_widget;
+unsigned int shaderProgram_fire;
+unsigned int shaderProgram_flow;
+unsigned int shaderProgram_arrow;
 unsigned int VBOs[NUM_OF_SHADER]; // vertex buffer objects
 unsigned int VAOs[NUM_OF_SHADER]; // vertex array objects
 unsigned int EBOs[NUM_OF_SHADER]; // element buffer objects
@@ -31,10 +37,17 @@ int status_coord_of_fire  = false;
 int mouse_state = NO_POINT_SET;
 int glob_filter_type = MEDIAN;
 int verbose_type = VERBT_FILTER;
-int escape_status = false;
+_Atomic int escape_status = false; // set by display thread, read by processing thread
 int glob_zero_point_fix = 0;
 float glob_zoom_ratio = 1.0;
 float glob_canvas_shift_y = 0.0;
 unsigned int video_texture = 0;
+JPEG_WRITER* jpeg_writer = NULL; // NULL === save images synchronously
+VIDEO_WRITER* video_writer = NULL; // NULL === without video output
+FLOW_FILE* flow_file = NULL; // NULL === flow not saved
+SHM_RING* shm_ring = NULL; // NULL === flow not exported to shared memory
+FLOW_STREAM* flow_stream = NULL; // NULL === flow not streamed to stdout
+MJPEG_SERVER* mjpeg_server = NULL; // NULL === without HTTP preview
+EVENT_RECORDER* event_recorder = NULL; // NULL === all frames written
 
 #endif /* MAIN_H */
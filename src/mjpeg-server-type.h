@@ -0,0 +1,46 @@
+/** \file
+   mjpeg-server-type.h --- header for mjpeg-server.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef MJPEG_SERVER_TYPE_H
+#define MJPEG_SERVER_TYPE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "image-type.h"
+
+typedef struct mjpeg_server {
+	int listen_fd;
+	pthread_t thread_accept;
+	pthread_t thread_encoder;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;   // new image, new JPEG, client exit or stop
+
+	_Atomic int clients;      // connected clients: 0 === nothing copied and encoded
+	int client_threads;       // running (detached) client threads
+	int stop;
+
+	int fps;                  // max frames per second of preview (independent of processing)
+	int quality;              // 0..100
+	struct timespec last_submit;
+
+	struct imgRawImage image; // last submitted image (copy), encoded by encoder thread
+	uint64_t image_seq;
+
+	unsigned char *jpeg;      // last encoded image, sent to all clients
+	unsigned long jpeg_size;
+	uint64_t jpeg_seq;
+
+	_Atomic unsigned long int sent; // frames sent to clients
+} MJPEG_SERVER;
+
+#endif /* MJPEG_SERVER_TYPE_H */
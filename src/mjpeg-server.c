@@ -0,0 +1,449 @@
+/** \file
+mjpeg-server.c --- headless preview: MJPEG stream of drawn optical flow over HTTP
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: optical flow mjpeg http preview headless server
+
+Usage:
+    ./optical_flow --mjpeg 8080 -d /dev/video0
+    curl -o frame.jpeg http://127.0.0.1:8080/frame.jpeg    # one frame
+    curl http://127.0.0.1:8080/ > stream.mjpeg             # multipart/x-mixed-replace stream (or open in browser)
+
+    threads:
+    accept  --- one thread per client (detached)
+    encoder --- compress last submitted image once for all clients
+    client  --- send every new JPEG to its socket (slow client lose frames, not slow down others)
+
+    processing (mjpeg_server_submit) only copy image, and only if client connected and
+    time of next preview frame came (rate limit independent of processing)
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "const.h"
+#include "mjpeg-server.h"
+#include "image.h"
+
+#define MJPEG_BOUNDARY "optical-flow-frame"
+#define MJPEG_REQUEST_LEN 1024
+
+typedef struct mjpeg_client {
+	MJPEG_SERVER* server;
+	int fd;
+} MJPEG_CLIENT;
+
+
+
+static int send_all (int fd, const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char*) data;
+	while (size > 0) {
+		ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent <= 0) return -1; // client closed, or timeout (SO_SNDTIMEO)
+		p += sent;
+		size -= sent;
+	}
+	return 0;
+}
+
+
+
+static int send_text (int fd, const char *text)
+{
+	return send_all(fd, text, strlen(text));
+}
+
+
+
+/**
+   Wait JPEG newer than last_seq
+
+   \param timeout_seconds 0 === wait without timeout
+   \return copy of JPEG (free by caller: last encoded if timeout), NULL if stop or nothing encoded yet
+*/
+static unsigned char *wait_jpeg (MJPEG_SERVER* server, uint64_t *last_seq, unsigned long *size, int timeout_seconds)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_seconds;
+
+	unsigned char *jpeg = NULL;
+	pthread_mutex_lock(&server->mutex);
+	while (!server->stop && server->jpeg_seq == *last_seq) {
+		if (timeout_seconds > 0 &&
+		    pthread_cond_timedwait(&server->changed, &server->mutex, &deadline) == ETIMEDOUT) break;
+		if (timeout_seconds <= 0) pthread_cond_wait(&server->changed, &server->mutex);
+	}
+	if (!server->stop && server->jpeg != NULL) {
+		jpeg = (unsigned char*) malloc(server->jpeg_size);
+		if (jpeg != NULL) {
+			memcpy(jpeg, server->jpeg, server->jpeg_size);
+			*size = server->jpeg_size;
+			*last_seq = server->jpeg_seq;
+		}
+	}
+	pthread_mutex_unlock(&server->mutex);
+	return jpeg;
+}
+
+
+
+static void serve_snapshot (MJPEG_SERVER* server, int fd)
+{
+	// newer frame (encoded after connect of client), or last encoded if timeout
+	pthread_mutex_lock(&server->mutex);
+	uint64_t last_seq = server->jpeg_seq;
+	pthread_mutex_unlock(&server->mutex);
+	unsigned long size = 0;
+	unsigned char *jpeg = wait_jpeg(server, &last_seq, &size, MJPEG_SNAPSHOT_TIMEOUT);
+	if (jpeg == NULL) {
+		send_text(fd, "HTTP/1.0 503 Service Unavailable\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nno frame yet\r\n");
+		return;
+	}
+
+	char header[256];
+	snprintf(header, sizeof(header),
+		 "HTTP/1.0 200 OK\r\nServer: optical-flow\r\nCache-Control: no-cache\r\nConnection: close\r\n"
+		 "Content-Type: image/jpeg\r\nContent-Length: %lu\r\n\r\n", size);
+	if (send_text(fd, header) == 0) send_all(fd, jpeg, size);
+	free(jpeg);
+}
+
+
+
+static void serve_stream (MJPEG_SERVER* server, int fd)
+{
+	if (send_text(fd, "HTTP/1.0 200 OK\r\nServer: optical-flow\r\nCache-Control: no-cache\r\nPragma: no-cache\r\nConnection: close\r\n"
+		      "Content-Type: multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY "\r\n\r\n") != 0) return;
+
+	uint64_t last_seq = 0; // last encoded frame sent at once
+	while (true) {
+		unsigned long size = 0;
+		unsigned char *jpeg = wait_jpeg(server, &last_seq, &size, 0);
+		if (jpeg == NULL) break; // stop
+
+		char header[128];
+		snprintf(header, sizeof(header), "--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %lu\r\n\r\n", size);
+		int result = send_text(fd, header);
+		if (result == 0) result = send_all(fd, jpeg, size);
+		if (result == 0) result = send_text(fd, "\r\n");
+		free(jpeg);
+		if (result != 0) break; // client closed
+		atomic_fetch_add(&server->sent, 1);
+	}
+}
+
+
+
+static void *client_thread (void *arg)
+{
+	MJPEG_CLIENT* client = (MJPEG_CLIENT*) arg;
+	MJPEG_SERVER* server = client->server;
+	int fd = client->fd;
+	free(client);
+
+	// slow or silent client not block stop of server
+	struct timeval timeout = {.tv_sec = MJPEG_SOCKET_TIMEOUT, .tv_usec = 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	char request[MJPEG_REQUEST_LEN];
+	ssize_t len = recv(fd, request, sizeof(request) - 1, 0);
+	if (len > 0) {
+		request[len] = '\0';
+		if (strncmp(request, "GET ", 4) != 0) {
+			send_text(fd, "HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\n\r\n");
+		} else {
+			atomic_fetch_add(&server->clients, 1); // processing start submit images
+			if (strncmp(request + 4, "/frame.jpeg", 11) == 0 || strncmp(request + 4, "/frame.jpg", 10) == 0) {
+				serve_snapshot(server, fd);
+			} else {
+				serve_stream(server, fd);
+			}
+			atomic_fetch_sub(&server->clients, 1);
+		}
+	}
+	close(fd);
+
+	pthread_mutex_lock(&server->mutex);
+	server->client_threads--;
+	pthread_cond_broadcast(&server->changed);
+	pthread_mutex_unlock(&server->mutex);
+	return NULL;
+}
+
+
+
+static void *accept_thread (void *arg)
+{
+	MJPEG_SERVER* server = (MJPEG_SERVER*) arg;
+
+	while (true) {
+		int fd = accept(server->listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break; // listen socket shut down (close_mjpeg_server)
+		}
+
+		MJPEG_CLIENT* client = (MJPEG_CLIENT*) malloc(sizeof(MJPEG_CLIENT));
+		pthread_mutex_lock(&server->mutex);
+		int stop = server->stop;
+		if (!stop && client != NULL) server->client_threads++;
+		pthread_mutex_unlock(&server->mutex);
+		if (stop || client == NULL) {
+			free(client);
+			close(fd);
+			continue;
+		}
+		client->server = server;
+		client->fd = fd;
+
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, client_thread, client) != 0) {
+			free(client);
+			close(fd);
+			pthread_mutex_lock(&server->mutex);
+			server->client_threads--;
+			pthread_mutex_unlock(&server->mutex);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+
+
+static void *encoder_thread (void *arg)
+{
+	MJPEG_SERVER* server = (MJPEG_SERVER*) arg;
+	struct imgRawImage image = {0};
+	uint64_t encoded_seq = 0;
+
+	pthread_mutex_lock(&server->mutex);
+	while (true) {
+		while (!server->stop && server->image_seq == encoded_seq) {
+			pthread_cond_wait(&server->changed, &server->mutex);
+		}
+		if (server->stop) break;
+
+		// copy under lock, compress without lock: processing not wait encoder
+		if (image.dwBufferBytes != server->image.dwBufferBytes) {
+			free(image.lpData);
+			image.lpData = (unsigned char*) malloc(server->image.dwBufferBytes);
+			image.dwBufferBytes = (image.lpData != NULL) ? server->image.dwBufferBytes : 0;
+		}
+		if (image.lpData == NULL) break;
+		image.numComponents = server->image.numComponents;
+		image.width = server->image.width;
+		image.height = server->image.height;
+		memcpy(image.lpData, server->image.lpData, image.dwBufferBytes);
+		encoded_seq = server->image_seq;
+		pthread_mutex_unlock(&server->mutex);
+
+		unsigned char *jpeg = NULL;
+		unsigned long jpeg_size = 0;
+		encodeJpegImageMemory(&image, server->quality, true, &jpeg, &jpeg_size);
+
+		pthread_mutex_lock(&server->mutex);
+		free(server->jpeg);
+		server->jpeg = jpeg;
+		server->jpeg_size = jpeg_size;
+		server->jpeg_seq++;
+		pthread_cond_broadcast(&server->changed);
+	}
+	pthread_mutex_unlock(&server->mutex);
+
+	free(image.lpData);
+	return NULL;
+}
+
+
+
+/**
+   \param address "port" (listen on localhost) or "ip:port" ("0.0.0.0:8080" === all interfaces)
+   \param fps max frames per second of preview
+*/
+int init_mjpeg_server (MJPEG_SERVER* server, char *address, int fps, int quality)
+{
+	memset(server, 0, sizeof(MJPEG_SERVER));
+	server->fps = (fps > 0) ? fps : MJPEG_FPS;
+	server->quality = quality;
+	atomic_store(&server->clients, 0);
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	char *port = strrchr(address, ':');
+	if (port != NULL) {
+		char host[INET_ADDRSTRLEN];
+		snprintf(host, sizeof(host), "%.*s", (int)(port - address), address);
+		if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+			printf("ERROR wrong address of preview server: %s\n", address);
+			return -1;
+		}
+		port++;
+	} else {
+		port = address;
+	}
+	long int port_num = strtol(port, NULL, 10);
+	if (port_num <= 0 || port_num > 65535) {
+		printf("ERROR wrong port of preview server: %s\n", address);
+		return -1;
+	}
+	addr.sin_port = htons(port_num);
+
+	server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (server->listen_fd < 0) return -1;
+	int reuse = 1;
+	setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+	    listen(server->listen_fd, MJPEG_BACKLOG) != 0) {
+		printf("ERROR could not listen: %s (%s)\n", address, strerror(errno));
+		close(server->listen_fd);
+		return -1;
+	}
+
+	pthread_mutex_init(&server->mutex, NULL);
+	pthread_cond_init(&server->changed, NULL);
+
+	if (pthread_create(&server->thread_encoder, NULL, encoder_thread, server) != 0) {
+		close(server->listen_fd);
+		return -1;
+	}
+	if (pthread_create(&server->thread_accept, NULL, accept_thread, server) != 0) {
+		pthread_mutex_lock(&server->mutex);
+		server->stop = true;
+		pthread_cond_broadcast(&server->changed);
+		pthread_mutex_unlock(&server->mutex);
+		pthread_join(server->thread_encoder, NULL);
+		close(server->listen_fd);
+		return -1;
+	}
+
+	char host[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+	printf("preview: http://%s:%ld/ (frame: /frame.jpeg) %d fps\n", host, port_num, server->fps);
+	return 0;
+}
+
+
+
+/**
+   \return number of connected clients (0 === image for preview not needed, not draw it)
+*/
+int mjpeg_server_clients (MJPEG_SERVER* server)
+{
+	return atomic_load(&server->clients);
+}
+
+
+
+/**
+   \return true if connected client wait for next preview frame (time of it came: rate limit)
+
+   same test as mjpeg_server_submit(), image for preview drawn only if it will be submitted
+*/
+int mjpeg_server_frame_due (MJPEG_SERVER* server)
+{
+	if (atomic_load(&server->clients) == 0) return false;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long int elapsed = (now.tv_sec - server->last_submit.tv_sec) * NANOSECONDS_IN_SECOND +
+		(now.tv_nsec - server->last_submit.tv_nsec);
+	return (elapsed >= NANOSECONDS_IN_SECOND / server->fps);
+}
+
+
+
+/**
+   Copy image for preview (image stay owned by caller)
+
+   nothing done without clients, or if next preview frame not needed yet (rate limit)
+*/
+void mjpeg_server_submit (MJPEG_SERVER* server, struct imgRawImage* image)
+{
+	if (image == NULL || image->numComponents != NUM_COMPONENTS_RGB || !mjpeg_server_frame_due(server)) return;
+	clock_gettime(CLOCK_MONOTONIC, &server->last_submit);
+
+	pthread_mutex_lock(&server->mutex);
+	if (server->image.dwBufferBytes != image->dwBufferBytes) {
+		free(server->image.lpData);
+		server->image.lpData = (unsigned char*) malloc(image->dwBufferBytes);
+		server->image.dwBufferBytes = (server->image.lpData != NULL) ? image->dwBufferBytes : 0;
+	}
+	if (server->image.lpData != NULL) {
+		server->image.numComponents = image->numComponents;
+		server->image.width = image->width;
+		server->image.height = image->height;
+		memcpy(server->image.lpData, image->lpData, image->dwBufferBytes);
+		server->image_seq++;
+		pthread_cond_broadcast(&server->changed);
+	}
+	pthread_mutex_unlock(&server->mutex);
+}
+
+
+
+void close_mjpeg_server (MJPEG_SERVER* server)
+{
+	pthread_mutex_lock(&server->mutex);
+	server->stop = true;
+	pthread_cond_broadcast(&server->changed);
+	pthread_mutex_unlock(&server->mutex);
+
+	shutdown(server->listen_fd, SHUT_RDWR); // wake up accept()
+	pthread_join(server->thread_accept, NULL);
+	pthread_join(server->thread_encoder, NULL);
+	close(server->listen_fd);
+
+	// client threads detached: wait end of sending (limited by socket timeout)
+	pthread_mutex_lock(&server->mutex);
+	while (server->client_threads > 0) {
+		pthread_cond_wait(&server->changed, &server->mutex);
+	}
+	pthread_mutex_unlock(&server->mutex);
+
+	printf("preview: %lu frames sent\n", atomic_load(&server->sent));
+
+	pthread_cond_destroy(&server->changed);
+	pthread_mutex_destroy(&server->mutex);
+	free(server->image.lpData);
+	free(server->jpeg);
+}
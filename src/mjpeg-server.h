@@ -0,0 +1,21 @@
+/** \file
+   mjpeg-server.h --- header for mjpeg-server.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef MJPEG_SERVER_H
+#define MJPEG_SERVER_H
+
+#include "mjpeg-server-type.h"
+
+int init_mjpeg_server (MJPEG_SERVER* server, char *address, int fps, int quality);
+int mjpeg_server_clients (MJPEG_SERVER* server);
+int mjpeg_server_frame_due (MJPEG_SERVER* server);
+void mjpeg_server_submit (MJPEG_SERVER* server, struct imgRawImage* image);
+void close_mjpeg_server (MJPEG_SERVER* server);
+
+#endif /* MJPEG_SERVER_H */
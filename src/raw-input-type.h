@@ -0,0 +1,35 @@
+/** \file
+   raw-input-type.h --- header for raw-input.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef RAW_INPUT_TYPE_H
+#define RAW_INPUT_TYPE_H
+
+#include <stdio.h>
+
+enum raw_format {RAW_NONE, RAW_GRAY, RAW_RGB, RAW_Y4M};
+
+typedef struct raw_input {
+	int format;
+	int width;
+	int height;
+	int num_components;            // of frame view: 1 (gray, luma of Y4M) or 3 (RGB)
+	unsigned long int frame_bytes; // all planes of frame
+	unsigned long int view_bytes;  // luma plane or RGB
+
+	// file: memory mapped
+	unsigned char *map;
+	size_t map_size;
+	size_t offset;
+
+	// pipe (stdin): read frame by frame into buffer
+	FILE *pipe;
+	unsigned char *buffer;
+} RAW_INPUT;
+
+#endif /* RAW_INPUT_TYPE_H */
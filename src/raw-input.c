@@ -0,0 +1,382 @@
+/** \file
+raw-input.c --- read raw gray/RGB or Y4M frames without libav decoding
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: raw video y4m yuv4mpeg mmap pipe
+
+Usage:
+    Reproducible benchmark of block matching (without decoder and colorspace conversion):
+
+    mx=320;my=256;head -c "$((3*mx*my*100))" /dev/urandom > random.rgb
+    ./optical_flow --raw rgb -s 320x256 --benchmark -d random.rgb
+
+    --benchmark: every block of every frame searched (not bounded by
+    OPTICAL_FLOW_FPS of process_image), nothing drawn or saved, printed
+    blocks and cost evaluations per second of matching.
+
+    ffmpeg -i video.mp4 -pix_fmt gray -f yuv4mpegpipe - | ./optical_flow --raw y4m -d -
+    ("-d -" without --raw: Y4M stream, libav input does not read stdin)
+
+    File is memory mapped and frames given to process_image() as views
+    (AVFrame point into map, not decoded), "-" === read frames from stdin
+    into buffer. process_image() copies (flips) view into buffer of
+    previous image once per frame (see frame_into_image).
+    Y4M: only luma plane used (gray image).
+
+History:
+    YUV4MPEG2 format: https://wiki.multimedia.cx/index.php/YUV4MPEG2
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "const.h"
+#include "raw-input.h"
+#include "image.h"
+#include "block-matching.h"
+#include "util.h"
+
+#define Y4M_MAX_HEADER_LEN 1024
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define Y4M_FRAME_MAGIC "FRAME"
+
+
+
+/**
+   \return RAW_NONE if name unknown
+*/
+int get_raw_format (char *name)
+{
+	if (strcmp(name, "gray") == 0 || strcmp(name, "grey") == 0) return RAW_GRAY;
+	if (strcmp(name, "rgb") == 0) return RAW_RGB;
+	if (strcmp(name, "y4m") == 0) return RAW_Y4M;
+	return RAW_NONE;
+}
+
+
+
+/**
+   parse stream header: "YUV4MPEG2 W640 H480 F30:1 Ip A1:1 C420jpeg"
+*/
+static int parse_y4m_header (char *header, RAW_INPUT* input)
+{
+	if (strncmp(header, Y4M_MAGIC, strlen(Y4M_MAGIC)) != 0) {
+		printf("not Y4M stream\n");
+		return -1;
+	}
+
+	unsigned long int chroma_bytes;
+	char colorspace[32] = "420";
+	char *token = strtok(header + strlen(Y4M_MAGIC), " \n");
+	while (token != NULL) {
+		switch (token[0]) {
+		case 'W': input->width = atoi(token + 1); break;
+		case 'H': input->height = atoi(token + 1); break;
+		case 'C': snprintf(colorspace, sizeof(colorspace), "%s", token + 1); break;
+		}
+		token = strtok(NULL, " \n");
+	}
+
+	if (input->width <= 0 || input->height <= 0) {
+		printf("Y4M: unknown frame size\n");
+		return -1;
+	}
+
+	unsigned long int w2 = (input->width + 1) / 2;
+	unsigned long int h2 = (input->height + 1) / 2;
+	// 8 bit per sample only: high bit depth (C420p10, C422p12, Cmono16, ...) rejected
+	if (strcmp(colorspace, "mono") == 0) {
+		chroma_bytes = 0;
+	} else if (strcmp(colorspace, "420jpeg") == 0 || strcmp(colorspace, "420paldv") == 0 ||
+		   strcmp(colorspace, "420mpeg2") == 0 || strcmp(colorspace, "420") == 0) {
+		chroma_bytes = 2 * w2 * h2;
+	} else if (strcmp(colorspace, "422") == 0) {
+		chroma_bytes = 2 * w2 * input->height;
+	} else if (strcmp(colorspace, "444") == 0) {
+		chroma_bytes = 2 * input->width * input->height;
+	} else if (strncmp(colorspace, "mono", 4) == 0 || strncmp(colorspace, "420p", 4) == 0 ||
+		   strncmp(colorspace, "422p", 4) == 0 || strncmp(colorspace, "444p", 4) == 0) {
+		printf("Y4M: high bit depth colorspace C%s not supported (8 bit only, use -pix_fmt gray)\n", colorspace);
+		return -1;
+	} else {
+		printf("Y4M: unsupported colorspace C%s\n", colorspace);
+		return -1;
+	}
+
+	input->num_components = 1; // luma only
+	input->view_bytes = input->width * input->height;
+	input->frame_bytes = input->view_bytes + chroma_bytes;
+	printf("Y4M: %d x %d C%s\n", input->width, input->height, colorspace);
+	return 0;
+}
+
+
+
+int open_raw_input (char *file_name, int format, int width, int height, RAW_INPUT* input)
+{
+	char header[Y4M_MAX_HEADER_LEN];
+
+	memset(input, 0, sizeof(RAW_INPUT));
+	input->format = format;
+	input->width = width;
+	input->height = height;
+
+	if (strcmp(file_name, "-") == 0) {
+		input->pipe = stdin;
+		if (format == RAW_Y4M) {
+			if (fgets(header, sizeof(header), input->pipe) == NULL) return -1;
+		}
+	} else {
+		int fd = open(file_name, O_RDONLY);
+		if (fd < 0) {
+			printf("ERROR could not open the file: %s\n", file_name);
+			return -1;
+		}
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+			printf("ERROR empty file: %s\n", file_name);
+			close(fd);
+			return -1;
+		}
+		input->map_size = file_stat.st_size;
+		input->map = mmap(NULL, input->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd); // map stay valid
+		if (input->map == MAP_FAILED) {
+			printf("ERROR could not map the file: %s\n", file_name);
+			input->map = NULL;
+			return -1;
+		}
+		madvise(input->map, input->map_size, MADV_SEQUENTIAL);
+
+		if (format == RAW_Y4M) {
+			unsigned char *end = memchr(input->map, '\n', MIN(input->map_size, sizeof(header) - 1));
+			if (end == NULL) {
+				printf("Y4M: header not found\n");
+				return -1;
+			}
+			input->offset = end - input->map + 1;
+			memcpy(header, input->map, input->offset);
+			header[input->offset] = 0;
+		}
+	}
+
+	switch (format) {
+	case RAW_Y4M:
+		if (parse_y4m_header(header, input) != 0) return -1;
+		break;
+	case RAW_GRAY:
+	case RAW_RGB:
+		if (width <= 0 || height <= 0) {
+			printf("raw input: need frame size (--size WxH)\n");
+			return -1;
+		}
+		input->num_components = (format == RAW_GRAY) ? 1 : NUM_COMPONENTS_RGB;
+		input->view_bytes = (unsigned long int)width * height * input->num_components;
+		input->frame_bytes = input->view_bytes;
+		break;
+	default:
+		return -1;
+	}
+
+	if (input->pipe != NULL) {
+		input->buffer = (unsigned char*)malloc(sizeof(unsigned char) * input->frame_bytes);
+	}
+	return 0;
+}
+
+
+
+/**
+   \param data point to frame (luma plane or RGB) in map or in buffer,
+   valid until next read_raw_frame (pipe) or close_raw_input (file)
+
+   \return 0 if frame read, -1 if end of stream
+*/
+int read_raw_frame (RAW_INPUT* input, unsigned char **data)
+{
+	if (input->pipe != NULL) {
+		if (input->format == RAW_Y4M) {
+			char frame_header[Y4M_MAX_HEADER_LEN];
+			if (fgets(frame_header, sizeof(frame_header), input->pipe) == NULL ||
+			    strncmp(frame_header, Y4M_FRAME_MAGIC, strlen(Y4M_FRAME_MAGIC)) != 0) return -1;
+		}
+		if (fread(input->buffer, 1, input->frame_bytes, input->pipe) != input->frame_bytes) return -1;
+		*data = input->buffer;
+		return 0;
+	}
+
+	if (input->format == RAW_Y4M) {
+		if (input->offset + strlen(Y4M_FRAME_MAGIC) > input->map_size ||
+		    memcmp(input->map + input->offset, Y4M_FRAME_MAGIC, strlen(Y4M_FRAME_MAGIC)) != 0) return -1;
+		unsigned char *end = memchr(input->map + input->offset, '\n', input->map_size - input->offset);
+		if (end == NULL) return -1;
+		input->offset = end - input->map + 1;
+	}
+	if (input->offset + input->frame_bytes > input->map_size) return -1;
+	*data = input->map + input->offset;
+	input->offset += input->frame_bytes;
+	return 0;
+}
+
+
+
+void close_raw_input (RAW_INPUT* input)
+{
+	if (input->map != NULL) munmap(input->map, input->map_size);
+	free(input->buffer);
+	input->map = NULL;
+	input->buffer = NULL;
+}
+
+
+
+/**
+   Benchmark: frame matched with previous (or first) frame to completion (all blocks searched,
+   without time bound of process_image) and without outputs
+
+   \return time of matching in seconds (0 === first frame, nothing matched)
+*/
+static double match_frame (AVFrame *pFrameView, int num_components, int compare_with_first, OPTICAL_FLOW* flow)
+{
+	struct imgRawImage* raw_image = frame_into_image(pFrameView, num_components, flow->spare_image);
+	flow->spare_image = NULL;
+	if (raw_image == NULL) {
+		printf("error: not enough memory for frame\n");
+		return 0.0;
+	}
+
+	double duration = 0.0;
+	if (flow->old_image != NULL) {
+		struct timespec ts_start;
+		struct timespec ts_end;
+		flow->raw_image = raw_image;
+		flow->gui_image = NULL; // nothing drawn
+		flow->display_image = raw_image;
+		clock_gettime(CLOCK_MONOTONIC, &ts_start);
+		block_matching_optimized_images (flow);
+		clock_gettime(CLOCK_MONOTONIC, &ts_end);
+		flow->frame_counter++;
+		duration = (double)(ts_end.tv_sec - ts_start.tv_sec) +
+			(double)(ts_end.tv_nsec - ts_start.tv_nsec) / (double)NANOSECONDS_IN_SECOND;
+	}
+
+	if (compare_with_first && flow->old_image != NULL) {
+		flow->spare_image = raw_image; // first image stay as old image
+	} else {
+		flow->spare_image = flow->old_image;
+		flow->old_image = raw_image;
+	}
+	return duration;
+}
+
+
+
+/**
+   Same as mainloop (see capture.c), but without decoder and colorspace conversion
+
+   \param benchmark frames matched to completion (see match_frame), throughput of matching printed
+*/
+int raw_mainloop (char *file_name, int format, int width, int height, int max_frame_count, int compare_with_first, int benchmark, unsigned int video_texture)
+{
+	extern _Atomic int escape_status;
+	extern int verbose;
+
+	RAW_INPUT input;
+	if (open_raw_input(file_name, format, width, height, &input) != 0) {
+		close_raw_input(&input);
+		return EXIT_FAILURE;
+	}
+
+	// view: point into map (or buffer), not own data
+	AVFrame *pFrameView = av_frame_alloc();
+	if (!pFrameView) {
+		printf("failed to allocated memory for AVFrame\n");
+		close_raw_input(&input);
+		return EXIT_FAILURE;
+	}
+	pFrameView->width = input.width;
+	pFrameView->height = input.height;
+	pFrameView->linesize[0] = input.width * input.num_components;
+	pFrameView->format = (input.num_components == 1) ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_RGB24;
+
+	OPTICAL_FLOW flow;
+	init_block_matching (input.width, input.height,
+			     OPTICAL_FLOW_BLOCK_SIZE, OPTICAL_FLOW_MAX_SHIFT_GLOBAL, OPTICAL_FLOW_MAX_SHIFT_LOCAL,
+			     OPTICAL_FLOW_EPSILON, OPTICAL_FLOW_HISTOGRAM_EPSILON,
+			     OPTICAL_FLOW_THRESHOLD,
+			     OPTICAL_FLOW_MIN_NEIGHBOURS,
+			     OPTICAL_FLOW_LONG_TIME_WITHOUT_UPDATE,
+			     OPTICAL_FLOW_PAINTED_BY_NEIGHBOR,
+			     &flow);
+	flow.time_bounded = !benchmark;
+	double matching_time = 0.0;
+
+	struct timespec ts_start;
+	struct timespec ts_end;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+	int frame_counter = 0;
+	unsigned char *data;
+	while (max_frame_count != 0 && atomic_load(&escape_status) == false &&
+	       read_raw_frame(&input, &data) == 0) { // max_frame_count == -1 infinity; > 0 limited frame number; == 0 exit
+		frame_counter++;
+		pFrameView->data[0] = data;
+		pFrameView->pts = AV_NOPTS_VALUE; // raw frames without timestamps
+		if (benchmark) {
+			matching_time += match_frame(pFrameView, input.num_components, compare_with_first, &flow);
+		} else {
+			process_image(pFrameView, NULL, frame_counter, compare_with_first, verbose, video_texture, input.num_components, &flow);
+		}
+		printf(" %d=", frame_counter);
+		if (max_frame_count > 0) max_frame_count--;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	double duration = (double)(ts_end.tv_sec - ts_start.tv_sec) +
+		(double)(ts_end.tv_nsec - ts_start.tv_nsec) / (double)NANOSECONDS_IN_SECOND;
+	printf("\nraw input: %d frames in %.3f s (%.2f fps)\n", frame_counter, duration,
+	       (duration > 0) ? frame_counter / duration : 0.0);
+	if (benchmark) {
+		// frame rate above is bounded by OPTICAL_FLOW_FPS only without benchmark (see process_image)
+		unsigned long int blocks = flow.frame_counter * flow.array_size;
+		printf("matching: %lu frames, %lu blocks, %lu cost evaluations in %.3f s (%.0f blocks/s, %.0f evaluations/s)\n",
+		       flow.frame_counter, blocks, flow.cost_evaluations, matching_time,
+		       (matching_time > 0) ? blocks / matching_time : 0.0,
+		       (matching_time > 0) ? flow.cost_evaluations / matching_time : 0.0);
+	}
+
+	free_block_matching (&flow);
+	av_frame_free(&pFrameView);
+	close_raw_input(&input);
+	return 0;
+}
@@ -0,0 +1,21 @@
+/** \file
+   raw-input.h --- header for raw-input.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef RAW_INPUT_H
+#define RAW_INPUT_H
+
+#include "raw-input-type.h"
+
+int get_raw_format (char *name);
+int open_raw_input (char *file_name, int format, int width, int height, RAW_INPUT* input);
+int read_raw_frame (RAW_INPUT* input, unsigned char **data);
+void close_raw_input (RAW_INPUT* input);
+int raw_mainloop (char *file_name, int format, int width, int height, int max_frame_count, int compare_with_first, int benchmark, unsigned int video_texture);
+
+#endif /* RAW_INPUT_H */
@@ -0,0 +1,31 @@
+/** \file
+   segments-type.h --- header for segments.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef SEGMENTS_TYPE_H
+#define SEGMENTS_TYPE_H
+
+#include <stdio.h>
+
+#include "capture-type.h"
+
+typedef struct segment {
+	int index;
+	char *file_name;
+	CAPTURE_OPTIONS* options;
+
+	double start;      // seconds from start of stream: frames [start, end) belong to segment
+	double end;
+	int warmup_frames; // processed before start (not saved): optical flow of context converge
+
+	FILE *output;      // per-frame results, copied to stdout in order of segments
+	unsigned long int processed; // frames of segment (without warm up)
+	int result;
+} SEGMENT;
+
+#endif /* SEGMENTS_TYPE_H */
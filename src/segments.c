@@ -0,0 +1,384 @@
+/** \file
+segments.c --- process one long video file by parallel segments
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: gop parallel segments seek keyframe
+
+Usage:
+    ./optical_flow --segments 0 -d record.mp4
+
+    File split by time into N segments (0 === one segment per core).
+    Every segment have own demuxer, decoder and OPTICAL_FLOW context:
+    seek to keyframe before start of segment, decode (without processing)
+    up to OPTICAL_FLOW_WARMUP_FRAMES frames before start, process this
+    frames for warm up of context (result not saved), then process frames
+    of segment.  Per-frame results written into temporary file of segment
+    and printed to stdout in order of segments; all other messages (of
+    segment threads too) moved to stderr while segments processed.
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "const.h"
+#include "segments.h"
+#include "capture.h"
+#include "image.h"
+#include "block-matching.h"
+#include "util.h"
+
+
+
+/**
+   Open file, find video stream and open its decoder
+
+   \return NULL on error
+*/
+static AVCodecContext *open_video_decoder (char *file_name, CAPTURE_OPTIONS* options, AVFormatContext **pFormatContext, int *video_stream_index)
+{
+	int result = avformat_open_input(pFormatContext, file_name, NULL, NULL);
+	if (result != 0) {
+		printf("ERROR could not open the file: [%d] %s\n", result, av_err2str(result));
+		return NULL;
+	}
+
+	if (avformat_find_stream_info(*pFormatContext, NULL) < 0) {
+		printf("ERROR could not find stream info: %s\n", file_name);
+		return NULL;
+	}
+
+	*video_stream_index = av_find_best_stream(*pFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (*video_stream_index < 0) {
+		printf("Error: File does not contain video stream");
+		return NULL;
+	}
+
+	AVCodecParameters *pCodecParameters = (*pFormatContext)->streams[*video_stream_index]->codecpar;
+	const AVCodec *pCodec = avcodec_find_decoder(pCodecParameters->codec_id);
+	if (pCodec == NULL) {
+		printf("ERROR unsupported codec!\n");
+		return NULL;
+	}
+
+	AVCodecContext *pCodecContext = avcodec_alloc_context3(pCodec);
+	if (!pCodecContext) {
+		printf("failed to allocated memory for AVCodecContext\n");
+		return NULL;
+	}
+
+	if (avcodec_parameters_to_context(pCodecContext, pCodecParameters) < 0) {
+		printf("failed to copy codec params to codec context\n");
+		avcodec_free_context(&pCodecContext);
+		return NULL;
+	}
+
+	set_decoder_threading(pCodecContext, options, false);
+
+	if (options->keyframes_only) {
+		pCodecContext->skip_frame = AVDISCARD_NONKEY;
+	}
+
+	AVDictionary *codec_options = NULL;
+	if (options->codec_mv) {
+		av_dict_set(&codec_options, "flags2", "+export_mvs", 0);
+	}
+
+	result = avcodec_open2(pCodecContext, pCodec, &codec_options);
+	av_dict_free(&codec_options);
+	if (result < 0) {
+		printf("failed to open codec through avcodec_open2\n");
+		avcodec_free_context(&pCodecContext);
+		return NULL;
+	}
+
+	return pCodecContext;
+}
+
+
+
+/**
+   Thread of one segment: own decoder and OPTICAL_FLOW context
+*/
+void *process_segment (void *vin)
+{
+	extern _Atomic int escape_status;
+	SEGMENT* segment = (SEGMENT*) vin;
+
+	segment->result = -1;
+	segment->processed = 0;
+
+	AVFormatContext *pFormatContext = NULL;
+	int video_stream_index;
+	AVCodecContext *pCodecContext = open_video_decoder(segment->file_name, segment->options, &pFormatContext, &video_stream_index);
+	if (pCodecContext == NULL) {
+		avformat_close_input(&pFormatContext);
+		return NULL;
+	}
+
+	AVStream *pStream = pFormatContext->streams[video_stream_index];
+	double time_base = av_q2d(pStream->time_base);
+	int64_t start_pts = (pStream->start_time != AV_NOPTS_VALUE) ? pStream->start_time : 0;
+
+	FRAME_SELECT select;
+	init_frame_select(&select, segment->options, pStream);
+
+	// frames of warm up: last frames of previous segment
+	double warmup_start = MAX(segment->start - (segment->warmup_frames + 0.5) * select.frame_duration, 0.0);
+	if (warmup_start > 0.0) {
+		// decoding start from keyframe before warm up frames
+		int64_t seek_pts = start_pts + (int64_t)(warmup_start / time_base);
+		if (av_seek_frame(pFormatContext, video_stream_index, seek_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+			printf("segment %d: seek to %.3f s failed\n", segment->index, warmup_start);
+			avcodec_free_context(&pCodecContext);
+			avformat_close_input(&pFormatContext);
+			return NULL;
+		}
+	}
+
+	AVFrame *pFrame = av_frame_alloc();
+	AVPacket *pPacket = av_packet_alloc();
+	if (pFrame == NULL || pPacket == NULL) {
+		printf("segment %d: failed to allocated memory for AVFrame or AVPacket\n", segment->index);
+		av_packet_free(&pPacket);
+		av_frame_free(&pFrame);
+		avcodec_free_context(&pCodecContext);
+		avformat_close_input(&pFormatContext);
+		return NULL;
+	}
+
+	int analysis_scale = MAX(segment->options->analysis_scale, 1);
+	struct SwsContext *sws_ctx = NULL;
+	unsigned char* frame_buffer_RGB = NULL;
+	AVFrame *pFrameRGB = alloc_rgb_frame(MAX(pCodecContext->width / analysis_scale, 1),
+					     MAX(pCodecContext->height / analysis_scale, 1),
+					     &frame_buffer_RGB);
+
+	struct SwsContext *sws_ctx_display = NULL;
+	unsigned char* frame_buffer_display = NULL;
+	AVFrame *pFrameDisplay = NULL; // NULL === same as pFrameRGB
+	if (analysis_scale > 1) {
+		pFrameDisplay = alloc_rgb_frame(pCodecContext->width, pCodecContext->height, &frame_buffer_display);
+	}
+
+	OPTICAL_FLOW flow;
+	init_block_matching (pFrameRGB->width, pFrameRGB->height,
+			     OPTICAL_FLOW_BLOCK_SIZE, OPTICAL_FLOW_MAX_SHIFT_GLOBAL, OPTICAL_FLOW_MAX_SHIFT_LOCAL,
+			     OPTICAL_FLOW_EPSILON, OPTICAL_FLOW_HISTOGRAM_EPSILON,
+			     OPTICAL_FLOW_THRESHOLD,
+			     OPTICAL_FLOW_MIN_NEIGHBOURS,
+			     OPTICAL_FLOW_LONG_TIME_WITHOUT_UPDATE,
+			     OPTICAL_FLOW_PAINTED_BY_NEIGHBOR,
+			     &flow);
+	flow.analysis_scale = analysis_scale;
+	if (segment->options->codec_mv) {
+		flow.seed_radius = segment->options->codec_mv_radius;
+	}
+
+	int end_of_segment = false;
+	while (end_of_segment == false && atomic_load(&escape_status) == false) {
+		int ret = av_read_frame(pFormatContext, pPacket);
+		if (ret >= 0 && pPacket->stream_index != video_stream_index) {
+			av_packet_unref(pPacket);
+			continue;
+		}
+
+		// end of file: flush decoder (NULL packet)
+		int response = avcodec_send_packet(pCodecContext, (ret >= 0) ? pPacket : NULL);
+		av_packet_unref(pPacket);
+		if (response < 0) {
+			printf("segment %d: error while sending a packet to the decoder: %s\n", segment->index, av_err2str(response));
+			break;
+		}
+
+		while (end_of_segment == false && avcodec_receive_frame(pCodecContext, pFrame) >= 0) {
+			int64_t pts = (pFrame->best_effort_timestamp != AV_NOPTS_VALUE) ? pFrame->best_effort_timestamp : pFrame->pts;
+			if (pts == AV_NOPTS_VALUE) continue;
+			double frame_time = (double)(pts - start_pts) * time_base;
+
+			if (frame_time >= segment->end) {
+				end_of_segment = true;
+			} else if (frame_time >= warmup_start &&
+				   select_frame(&select, pFrame, &flow)) {
+				flow.warm_up = (frame_time < segment->start);
+				// number of frame in whole file (same as in sequential processing)
+				int frame_number = lround(frame_time / select.frame_duration) + 1;
+				process_frame(pFrame, frame_number, pFrameRGB, &sws_ctx, pFrameDisplay, &sws_ctx_display, false, 0, NUM_COMPONENTS_RGB, &flow);
+				if (flow.warm_up == false) {
+					print_flow_summary(segment->output, frame_number, frame_time, &flow);
+					segment->processed++;
+				}
+			}
+		}
+
+		if (ret < 0) break; // end of file
+	}
+
+	free_block_matching (&flow);
+	sws_freeContext(sws_ctx);
+	av_free(frame_buffer_RGB);
+	av_frame_free(&pFrameRGB);
+	if (pFrameDisplay != NULL) {
+		sws_freeContext(sws_ctx_display);
+		av_free(frame_buffer_display);
+		av_frame_free(&pFrameDisplay);
+	}
+	av_packet_free(&pPacket);
+	av_frame_free(&pFrame);
+	avcodec_free_context(&pCodecContext);
+	avformat_close_input(&pFormatContext);
+
+	segment->result = 0;
+	return NULL;
+}
+
+
+
+/**
+   Process file by segments_num parallel segments (0 === one segment per core)
+*/
+int segments_mainloop (char *file_name, int segments_num, CAPTURE_OPTIONS* options)
+{
+	struct timespec ts_start;
+	struct timespec ts_end;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+	if (segments_num <= 0) segments_num = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+	// duration and frame rate of video stream
+	AVFormatContext* pFormatContext = NULL;
+	if (avformat_open_input(&pFormatContext, file_name, NULL, NULL) != 0 ||
+	    avformat_find_stream_info(pFormatContext, NULL) < 0) {
+		printf("ERROR could not open the file: %s\n", file_name);
+		avformat_close_input(&pFormatContext);
+		return EXIT_FAILURE;
+	}
+	int video_stream_index = av_find_best_stream(pFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (video_stream_index < 0) {
+		printf("Error: File does not contain video stream");
+		avformat_close_input(&pFormatContext);
+		return EXIT_FAILURE;
+	}
+	AVStream *pStream = pFormatContext->streams[video_stream_index];
+	double duration = (pStream->duration != AV_NOPTS_VALUE) ?
+		pStream->duration * av_q2d(pStream->time_base) :
+		(double)pFormatContext->duration / AV_TIME_BASE;
+	AVRational frame_rate = (pStream->avg_frame_rate.num > 0 && pStream->avg_frame_rate.den > 0) ?
+		pStream->avg_frame_rate : pStream->r_frame_rate;
+	avformat_close_input(&pFormatContext);
+
+	if (duration <= 0.0 || frame_rate.num <= 0 || frame_rate.den <= 0) {
+		printf("segments: unknown duration or frame rate of %s (use sequential processing)\n", file_name);
+		return EXIT_FAILURE;
+	}
+	printf("segments: %d, duration %.3f s, frame rate %d/%d\n", segments_num, duration, frame_rate.num, frame_rate.den);
+
+	// parallel segments instead of parallel decoder threads
+	CAPTURE_OPTIONS segment_options = *options;
+	if (segment_options.thread_count == 0) segment_options.thread_count = 1;
+
+	SEGMENT* segments = (SEGMENT*) calloc(segments_num, sizeof(SEGMENT));
+	pthread_t* threads = (pthread_t*) calloc(segments_num, sizeof(pthread_t));
+	if (segments == NULL || threads == NULL) {
+		printf("segments: not enough memory for %d segments\n", segments_num);
+		free(segments);
+		free(threads);
+		return EXIT_FAILURE;
+	}
+
+	// stdout carry only per-frame records in order: messages of segment threads (printf) moved to stderr
+	fflush(stdout);
+	int records_fd = dup(STDOUT_FILENO);
+	FILE *records = (records_fd >= 0) ? fdopen(records_fd, "w") : NULL;
+	if (records == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		fprintf(stderr, "ERROR could not redirect stdout\n");
+		if (records != NULL) fclose(records);
+		else if (records_fd >= 0) close(records_fd);
+		free(segments);
+		free(threads);
+		return EXIT_FAILURE;
+	}
+	int created = 0;
+
+	for (int i = 0; i < segments_num; i++) {
+		segments[i].index = i;
+		segments[i].file_name = file_name;
+		segments[i].options = &segment_options;
+		segments[i].start = duration * i / segments_num;
+		segments[i].end = (i == segments_num - 1) ? INFINITY : duration * (i + 1) / segments_num; // duration of header can be inexact
+		segments[i].warmup_frames = (i == 0) ? 0 : OPTICAL_FLOW_WARMUP_FRAMES;
+		segments[i].output = tmpfile();
+		if (segments[i].output == NULL) {
+			printf("segments: can not create temporary file\n");
+			break;
+		}
+		if (pthread_create(&threads[i], NULL, process_segment, &segments[i]) != 0) {
+			printf("segments: can not create thread\n");
+			fclose(segments[i].output);
+			break;
+		}
+		created++;
+	}
+
+	// stitch per-frame results in order
+	int result = (created == segments_num) ? 0 : EXIT_FAILURE;
+	unsigned long int processed = 0;
+	for (int i = 0; i < created; i++) {
+		pthread_join(threads[i], NULL);
+		if (segments[i].result != 0) result = EXIT_FAILURE;
+
+		rewind(segments[i].output);
+		char buffer[BUFSIZ];
+		size_t len;
+		while ((len = fread(buffer, 1, sizeof(buffer), segments[i].output)) > 0) {
+			fwrite(buffer, 1, len, records);
+		}
+		fclose(segments[i].output);
+		processed += segments[i].processed;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	double time_duration = (double)(ts_end.tv_sec - ts_start.tv_sec) +
+		(double)(ts_end.tv_nsec - ts_start.tv_nsec) / (double)NANOSECONDS_IN_SECOND;
+	printf("segments: %lu frames in %.3f s (%.2f fps)\n", processed, time_duration,
+	       (time_duration > 0) ? processed / time_duration : 0.0);
+
+	// stdout restored
+	fflush(stdout);
+	fflush(records);
+	dup2(records_fd, STDOUT_FILENO);
+	fclose(records);
+
+	free(threads);
+	free(segments);
+	return result;
+}
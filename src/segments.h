@@ -0,0 +1,18 @@
+/** \file
+   segments.h --- header for segments.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include "segments-type.h"
+
+int segments_mainloop (char *file_name, int segments_num, CAPTURE_OPTIONS* options);
+void *process_segment (void *vin);
+
+#endif /* SEGMENTS_H */
@@ -0,0 +1,106 @@
+/** \file
+shm-reader.c --- example of consumer: read optical flow from shared memory of ./optical_flow
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: optical flow shared memory reader example
+
+Usage:
+    ./optical_flow --shm /optical-flow -d /dev/video0
+    ./shm_reader /optical-flow [frames]
+
+    print mean shift of blocks for every frame (and mean luma, if exported)
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "shm-ring.h"
+
+#define SHM_READER_TIMEOUT_MS 1000
+
+
+
+int main (int argc, char **argv)
+{
+	char *name = (argc > 1) ? argv[1] : SHM_RING_NAME;
+	long int max_frames = (argc > 2) ? strtol(argv[2], NULL, 0) : -1;
+
+	SHM_RING_MAP ring_map;
+	while (open_shm_ring(name, &ring_map) != 0) {
+		printf("wait shared memory: %s\n", name);
+		sleep(1);
+	}
+	SHM_RING_HEADER* header = ring_map.header;
+	printf("grid %ux%u blocks of %u pixels, luma %ux%u, %u slots\n",
+	       header->grid_width, header->grid_height, header->block_size,
+	       header->luma_width, header->luma_height, header->slot_count);
+
+	uint64_t last_seq = atomic_load(&header->write_seq);
+	long int frames = 0;
+	while (max_frames < 0 || frames < max_frames) {
+		uint64_t seq = wait_shm_ring(&ring_map, last_seq, SHM_READER_TIMEOUT_MS);
+		if (seq == last_seq) {
+			printf("timeout\n");
+			continue;
+		}
+		if (seq - last_seq > 1 && last_seq > 0) printf("lost %lu frames\n", (unsigned long int)(seq - last_seq - 1));
+		last_seq = seq;
+
+		// zero-copy: data used in place, checked after use
+		SHM_RING_SLOT* slot = get_shm_ring_slot(&ring_map, seq);
+		if (slot == NULL) continue;
+		SHM_RING_BLOCK* blocks = get_shm_ring_blocks(&ring_map, slot);
+		unsigned long int grid_len = (unsigned long int)header->grid_width * header->grid_height;
+		double sum_x = 0.0;
+		double sum_y = 0.0;
+		for (unsigned long int i = 0; i < grid_len; i++) {
+			sum_x += blocks[i].shift_x;
+			sum_y += blocks[i].shift_y;
+		}
+		int64_t frame_number = slot->frame_number;
+		unsigned char *luma = get_shm_ring_luma(&ring_map, slot);
+		double sum_luma = 0.0;
+		if (luma != NULL) {
+			for (uint64_t i = 0; i < header->luma_size; i++) sum_luma += luma[i];
+		}
+		if (!check_shm_ring_slot(slot, seq)) {
+			printf("frame %lu overwritten during reading\n", (unsigned long int)seq);
+			continue;
+		}
+
+		printf("frame %ld: mean shift = [%.2f %.2f]", (long int)frame_number, sum_x / grid_len, sum_y / grid_len);
+		if (luma != NULL) printf(" mean luma = %.1f", sum_luma / header->luma_size);
+		printf("\n");
+		frames++;
+	}
+
+	close_shm_ring_map(&ring_map);
+	return 0;
+}
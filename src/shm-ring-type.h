@@ -0,0 +1,93 @@
+/** \file
+   shm-ring-type.h --- header for shm-ring.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+   POSIX shared memory object (/dev/shm/<name>, native byte order):
+
+   SHM_RING_HEADER
+   slot 0: SHM_RING_SLOT, blocks (SHM_RING_BLOCK * grid_width * grid_height, row by row),
+           luma (uint8 * luma_width * luma_height, if luma_size > 0), padding up to slot_size
+   slot 1
+   ...
+   slot slot_count - 1
+
+   Frame with sequence number seq (1, 2, 3, ...) written into slot seq % slot_count.
+   Writer: slot->seq_begin = seq; data; slot->seq_end = seq; header->write_seq = seq;
+           header->futex = (uint32_t)seq; FUTEX_WAKE.
+   Reader (zero-copy, in place): wait futex while equal to last seen value,
+           take seq = header->write_seq, check slot->seq_end == seq, use data,
+           after use check slot->seq_begin == seq (else slot overwritten: frame lost).
+
+   Grid and luma bottom-up (row 0 is bottom of image, positive shift_y is move up),
+   shift in pixels of analysis image (multiply by analysis_scale), as in flow-file-type.h.
+*/
+
+// include guard
+#ifndef SHM_RING_TYPE_H
+#define SHM_RING_TYPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define SHM_RING_MAGIC "OFSHMRG1"
+#define SHM_RING_MAGIC_LEN 8
+#define SHM_RING_VERSION 1
+
+typedef struct shm_ring_block {
+	int16_t shift_x;
+	int16_t shift_y;
+	uint16_t cost;           // mean absolute difference of pixels * 256
+	uint16_t age;            // frames since last update of block (saturated)
+} SHM_RING_BLOCK;
+
+typedef struct shm_ring_slot {
+	_Atomic uint64_t seq_begin;
+	_Atomic uint64_t seq_end;
+	int64_t frame_number;    // number of frame in source
+	uint32_t frame_distance; // to previous processed frame (in frames of source)
+	uint32_t reserved;
+} SHM_RING_SLOT;
+
+typedef struct shm_ring_header {
+	char magic[SHM_RING_MAGIC_LEN];
+	uint32_t version;
+	uint32_t slot_count;
+	uint64_t slot_size;      // bytes (with SHM_RING_SLOT), multiple of 64
+	uint32_t grid_width;     // blocks
+	uint32_t grid_height;
+	uint32_t block_size;     // pixels of analysis image
+	uint32_t analysis_scale;
+	uint32_t luma_width;     // analysis image
+	uint32_t luma_height;
+	uint64_t luma_size;      // 0 === without luma
+	uint64_t blocks_offset;  // from start of slot
+	uint64_t luma_offset;
+	_Atomic uint64_t write_seq; // last published frame (0 === nothing yet)
+	_Atomic uint32_t futex;  // low 32 bits of write_seq: wait on it
+	uint32_t reserved;
+} SHM_RING_HEADER;
+
+// writer
+typedef struct shm_ring {
+	char *name;              // "/optical-flow"
+	int slot_count;
+	int luma;                // export luma of analysis image too
+	unsigned char *map;      // NULL === not created yet (size of grid unknown before first frame)
+	size_t map_size;
+	SHM_RING_HEADER* header;
+	uint64_t seq;
+} SHM_RING;
+
+// reader
+typedef struct shm_ring_map {
+	unsigned char *map;
+	size_t map_size;
+	SHM_RING_HEADER* header;
+} SHM_RING_MAP;
+
+#endif /* SHM_RING_TYPE_H */
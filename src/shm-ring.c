@@ -0,0 +1,338 @@
+/** \file
+shm-ring.c --- ring of optical flow frames in POSIX shared memory for other processes
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: optical flow shared memory ring buffer futex zero-copy
+
+Usage:
+    ./optical_flow --shm /optical-flow --shm-luma -d /dev/video0
+    ./shm_reader /optical-flow
+
+    writer: init_shm_ring(), write_shm_ring() for every frame, close_shm_ring()
+    reader: open_shm_ring(), wait_shm_ring(), get_shm_ring_slot(), get_shm_ring_blocks(),
+            get_shm_ring_luma(), check_shm_ring_slot() after use, close_shm_ring_map()
+
+    Layout of shared memory and protocol see in shm-ring-type.h
+
+History:
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "const.h"
+#include "shm-ring.h"
+#include "util.h"
+
+#define SHM_RING_ALIGN 64 // cache line
+
+
+
+static long int futex (_Atomic uint32_t *address, int operation, uint32_t value, const struct timespec *timeout)
+{
+	// not FUTEX_PRIVATE_FLAG: waiter and waker in different processes
+	return syscall(SYS_futex, (uint32_t*)address, operation, value, timeout, NULL, 0);
+}
+
+
+
+static long int saturate (long int value, long int min, long int max)
+{
+	return MIN(MAX(value, min), max);
+}
+
+
+
+/**
+   Shared memory created by first frame (size of grid unknown before)
+
+   \param name of shared memory object: "/optical-flow"
+   \param luma export luma of analysis image with flow
+*/
+int init_shm_ring (SHM_RING* ring, char *name, int slot_count, int luma)
+{
+	memset(ring, 0, sizeof(SHM_RING));
+	if (name == NULL || name[0] != '/' || slot_count < 2) {
+		printf("ERROR shared memory name must start with '/', slots >= 2: %s %d\n", name ? name : "", slot_count);
+		return -1;
+	}
+	ring->name = name;
+	ring->slot_count = slot_count;
+	ring->luma = luma;
+	return 0;
+}
+
+
+
+static int create_shm_ring (SHM_RING* ring, OPTICAL_FLOW* flow)
+{
+	struct imgRawImage* image = flow->raw_image;
+	uint64_t grid_len = (uint64_t)flow->width * flow->height;
+	uint64_t luma_size = (ring->luma && image != NULL) ? (uint64_t)image->width * image->height : 0;
+
+	uint64_t blocks_offset = (sizeof(SHM_RING_SLOT) + 7) & ~7UL;
+	uint64_t luma_offset = blocks_offset + grid_len * sizeof(SHM_RING_BLOCK);
+	uint64_t slot_size = (luma_offset + luma_size + SHM_RING_ALIGN - 1) & ~(uint64_t)(SHM_RING_ALIGN - 1);
+	uint64_t header_size = (sizeof(SHM_RING_HEADER) + SHM_RING_ALIGN - 1) & ~(uint64_t)(SHM_RING_ALIGN - 1);
+	ring->map_size = header_size + slot_size * ring->slot_count;
+
+	// readers of previous run keep old (unlinked) object: they reopen by magic/version check
+	shm_unlink(ring->name);
+	int fd = shm_open(ring->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		printf("ERROR could not create shared memory: %s\n", ring->name);
+		return -1;
+	}
+	if (ftruncate(fd, ring->map_size) != 0) {
+		printf("ERROR could not allocate shared memory: %s %lu bytes\n", ring->name, (unsigned long int)ring->map_size);
+		close(fd);
+		shm_unlink(ring->name);
+		return -1;
+	}
+	ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		shm_unlink(ring->name);
+		return -1;
+	}
+
+	// object filled by zeros (ftruncate): seq 0 === empty slot
+	SHM_RING_HEADER* header = (SHM_RING_HEADER*) ring->map;
+	header->version = SHM_RING_VERSION;
+	header->slot_count = ring->slot_count;
+	header->slot_size = slot_size;
+	header->grid_width = flow->width;
+	header->grid_height = flow->height;
+	header->block_size = flow->block_size_in_pixel;
+	header->analysis_scale = flow->analysis_scale;
+	header->luma_width = (luma_size > 0) ? image->width : 0;
+	header->luma_height = (luma_size > 0) ? image->height : 0;
+	header->luma_size = luma_size;
+	header->blocks_offset = blocks_offset;
+	header->luma_offset = luma_offset;
+	// magic last: reader opened before end of initialization see not ready object
+	atomic_thread_fence(memory_order_release);
+	memcpy(header->magic, SHM_RING_MAGIC, SHM_RING_MAGIC_LEN);
+
+	ring->header = header;
+	printf("shared memory: %s %d slots of %lu bytes\n", ring->name, ring->slot_count, (unsigned long int)slot_size);
+	return 0;
+}
+
+
+
+static SHM_RING_SLOT* get_slot (SHM_RING_HEADER* header, uint64_t seq)
+{
+	uint64_t header_size = (sizeof(SHM_RING_HEADER) + SHM_RING_ALIGN - 1) & ~(uint64_t)(SHM_RING_ALIGN - 1);
+	return (SHM_RING_SLOT*) ((unsigned char*)header + header_size + (seq % header->slot_count) * header->slot_size);
+}
+
+
+
+static void copy_luma (struct imgRawImage* image, unsigned char *luma)
+{
+	unsigned long int len = image->width * image->height;
+	if (image->numComponents == 1) {
+		memcpy(luma, image->lpData, len);
+		return;
+	}
+	// BT.601: Y = 0.299 R + 0.587 G + 0.114 B
+	unsigned char *pixel = image->lpData;
+	for (unsigned long int i = 0; i < len; i++, pixel += image->numComponents) {
+		luma[i] = (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2]) >> 8;
+	}
+}
+
+
+
+int write_shm_ring (SHM_RING* ring, int64_t frame_number, OPTICAL_FLOW* flow)
+{
+	if (ring->map == NULL && create_shm_ring(ring, flow) != 0) return -1;
+	SHM_RING_HEADER* header = ring->header;
+	if (flow->array_size != (unsigned long int)header->grid_width * header->grid_height) return -1;
+
+	uint64_t seq = ++ring->seq;
+	SHM_RING_SLOT* slot = get_slot(header, seq);
+
+	// seqlock: reader check seq_begin after use of data
+	atomic_store_explicit(&slot->seq_begin, seq, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->frame_number = frame_number;
+	slot->frame_distance = flow->frame_distance;
+	SHM_RING_BLOCK* blocks = (SHM_RING_BLOCK*) ((unsigned char*)slot + header->blocks_offset);
+	for (unsigned long int i = 0; i < flow->array_size; i++) {
+		BLK* blk = &flow->array[i];
+		blocks[i].shift_x = saturate(blk->shift.x, INT16_MIN, INT16_MAX);
+		blocks[i].shift_y = saturate(blk->shift.y, INT16_MIN, INT16_MAX);
+		blocks[i].cost = saturate(lround(blk->diff * 256.0), 0, UINT16_MAX);
+		blocks[i].age = saturate(blk->last_update, 0, UINT16_MAX);
+	}
+	struct imgRawImage* image = flow->raw_image;
+	if (header->luma_size > 0 && image != NULL &&
+	    image->width == header->luma_width && image->height == header->luma_height) {
+		copy_luma(image, (unsigned char*)slot + header->luma_offset);
+	}
+
+	atomic_store_explicit(&slot->seq_end, seq, memory_order_release);
+	atomic_store_explicit(&header->write_seq, seq, memory_order_release);
+	atomic_store_explicit(&header->futex, (uint32_t)seq, memory_order_release);
+	futex(&header->futex, FUTEX_WAKE, INT_MAX, NULL);
+	return 0;
+}
+
+
+
+void close_shm_ring (SHM_RING* ring)
+{
+	if (ring->map == NULL) return;
+	printf("shared memory: %s %lu frames\n", ring->name, (unsigned long int)ring->seq);
+	munmap(ring->map, ring->map_size);
+	shm_unlink(ring->name);
+	ring->map = NULL;
+}
+
+
+
+/**
+   \return -1 if object not exist or not initialized yet (writer create it by first frame): try later
+*/
+int open_shm_ring (char *name, SHM_RING_MAP* ring_map)
+{
+	memset(ring_map, 0, sizeof(SHM_RING_MAP));
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) return -1;
+	struct stat shm_stat;
+	if (fstat(fd, &shm_stat) != 0 || (size_t)shm_stat.st_size < sizeof(SHM_RING_HEADER)) {
+		close(fd);
+		return -1;
+	}
+	ring_map->map_size = shm_stat.st_size;
+	ring_map->map = mmap(NULL, ring_map->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring_map->map == MAP_FAILED) {
+		ring_map->map = NULL;
+		return -1;
+	}
+
+	SHM_RING_HEADER* header = (SHM_RING_HEADER*) ring_map->map;
+	ring_map->header = header;
+	if (memcmp(header->magic, SHM_RING_MAGIC, SHM_RING_MAGIC_LEN) != 0) {
+		close_shm_ring_map(ring_map);
+		return -1;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	if (header->version != SHM_RING_VERSION || header->slot_count == 0 ||
+	    (unsigned char*)get_slot(header, header->slot_count - 1) + header->slot_size > ring_map->map + ring_map->map_size) {
+		printf("ERROR unknown version of shared memory: %s\n", name);
+		close_shm_ring_map(ring_map);
+		return -1;
+	}
+	return 0;
+}
+
+
+
+/**
+   Wait new frame (futex)
+
+   \return sequence number of last published frame, last_seq if timeout
+*/
+uint64_t wait_shm_ring (SHM_RING_MAP* ring_map, uint64_t last_seq, int timeout_ms)
+{
+	SHM_RING_HEADER* header = ring_map->header;
+	uint64_t seq = atomic_load_explicit(&header->write_seq, memory_order_acquire);
+	if (seq != last_seq) return seq;
+
+	// writer store futex after write_seq: if changed, FUTEX_WAIT return immediately
+	struct timespec timeout = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+	futex(&header->futex, FUTEX_WAIT, (uint32_t)last_seq, &timeout);
+	return atomic_load_explicit(&header->write_seq, memory_order_acquire);
+}
+
+
+
+/**
+   \return NULL if slot already overwritten by newer frame (or not written yet)
+*/
+SHM_RING_SLOT* get_shm_ring_slot (SHM_RING_MAP* ring_map, uint64_t seq)
+{
+	if (seq == 0) return NULL;
+	SHM_RING_SLOT* slot = get_slot(ring_map->header, seq);
+	if (atomic_load_explicit(&slot->seq_end, memory_order_acquire) != seq) return NULL;
+	return slot;
+}
+
+
+
+/**
+   Check after use of data: writer could overwrite slot during reading
+
+   \return true if data of slot was consistent
+*/
+int check_shm_ring_slot (SHM_RING_SLOT* slot, uint64_t seq)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&slot->seq_begin, memory_order_relaxed) == seq;
+}
+
+
+
+SHM_RING_BLOCK* get_shm_ring_blocks (SHM_RING_MAP* ring_map, SHM_RING_SLOT* slot)
+{
+	return (SHM_RING_BLOCK*) ((unsigned char*)slot + ring_map->header->blocks_offset);
+}
+
+
+
+/**
+   \return NULL if luma not exported
+*/
+unsigned char* get_shm_ring_luma (SHM_RING_MAP* ring_map, SHM_RING_SLOT* slot)
+{
+	if (ring_map->header->luma_size == 0) return NULL;
+	return (unsigned char*)slot + ring_map->header->luma_offset;
+}
+
+
+
+void close_shm_ring_map (SHM_RING_MAP* ring_map)
+{
+	if (ring_map->map != NULL) munmap(ring_map->map, ring_map->map_size);
+	ring_map->map = NULL;
+}
@@ -0,0 +1,29 @@
+/** \file
+   shm-ring.h --- header for shm-ring.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include "shm-ring-type.h"
+#include "image-type.h"
+#include "block-matching-type.h"
+
+int init_shm_ring (SHM_RING* ring, char *name, int slot_count, int luma);
+int write_shm_ring (SHM_RING* ring, int64_t frame_number, OPTICAL_FLOW* flow);
+void close_shm_ring (SHM_RING* ring);
+
+int open_shm_ring (char *name, SHM_RING_MAP* ring_map);
+uint64_t wait_shm_ring (SHM_RING_MAP* ring_map, uint64_t last_seq, int timeout_ms);
+SHM_RING_SLOT* get_shm_ring_slot (SHM_RING_MAP* ring_map, uint64_t seq);
+int check_shm_ring_slot (SHM_RING_SLOT* slot, uint64_t seq);
+SHM_RING_BLOCK* get_shm_ring_blocks (SHM_RING_MAP* ring_map, SHM_RING_SLOT* slot);
+unsigned char* get_shm_ring_luma (SHM_RING_MAP* ring_map, SHM_RING_SLOT* slot);
+void close_shm_ring_map (SHM_RING_MAP* ring_map);
+
+#endif /* SHM_RING_H */
@@ -34,10 +34,18 @@ Code:
 
 #include <stdio.h>
 #include <string.h> // memset
+#include <unistd.h> // unlink
 
 #include "const.h"
 #include "gui.h"
 #include "block-matching.h"
+#include "jpeg-writer.h"
+#include "video-writer.h"
+#include "flow-file.h"
+#include "shm-ring.h"
+#include "flow-stream.h"
+#include "mjpeg-server.h"
+#include "event-recorder.h"
 
 //#define DEBUG
 
@@ -52,10 +60,16 @@ struct imgRawImage* raw_image;
 struct imgRawImage* gui_image;
 struct imgRawImage* old_image;
 int verbose = VERBOSE_NO;
-int hide_static_block = false;
+_Atomic int hide_static_block = false;
+int search_mode = SEARCH_FULL;
+int global_motion = false;
+int quadtree_size = 0;
 GLFWwindow* window;
 unsigned int shaderProgram_video;
 unsigned int shaderProgram_widget;
+unsigned int shaderProgram_fire;
+unsigned int shaderProgram_flow;
+unsigned int shaderProgram_arrow;
 unsigned int VBOs[NUM_OF_SHADER]; // vertex buffer objects
 unsigned int VAOs[NUM_OF_SHADER]; // vertex array objects
 unsigned int EBOs[NUM_OF_SHADER]; // element buffer objects
@@ -66,11 +80,18 @@ int status_coord_of_fire  = false;
 int mouse_state = NO_POINT_SET;
 int glob_filter_type = MEDIAN;
 int verbose_type = VERBT_FILTER;
-int escape_status = false;
+_Atomic int escape_status = false;
 int glob_zero_point_fix = 0;
 float glob_zoom_ratio = 1.0;
 float glob_canvas_shift_y = 0.0;
 unsigned int video_texture = 0;
+JPEG_WRITER* jpeg_writer = NULL;
+VIDEO_WRITER* video_writer = NULL;
+FLOW_FILE* flow_file = NULL;
+SHM_RING* shm_ring = NULL;
+FLOW_STREAM* flow_stream = NULL;
+MJPEG_SERVER* mjpeg_server = NULL;
+EVENT_RECORDER* event_recorder = NULL;
 
 unsigned char image_a0 [] = {
 //      1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12
@@ -103,6 +124,14 @@ unsigned char image_a1 [] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};  // 12
 
 unsigned char image_empty [IMG_SIZE*IMG_SIZE];
+unsigned char image_texture [IMG_SIZE*IMG_SIZE];
+unsigned char image_texture_moved [IMG_SIZE*IMG_SIZE]; // image_texture moved by [2 1]
+
+#define SCENE_WIDTH 480
+#define SCENE_HEIGHT 384
+#define OBJECT_SIZE 32
+unsigned char scene_old [SCENE_WIDTH*SCENE_HEIGHT];
+unsigned char scene_new [SCENE_WIDTH*SCENE_HEIGHT]; // object of scene_old (at 200 160) moved by [2 1]
 
 
 
@@ -169,12 +198,202 @@ int main ()
 	print_image (raw_image);
 
 	printf("best shift = [%ld %ld]\n", best_shift.x, best_shift.y);
+
+
+	// predictive search: same result by few evaluations of cost
+	flow.cost_evaluations = 0;
+	best_shift = find_block_correlation_epzs (old_image, raw_image, gui_image,
+						  block, BLOCK_SIZE_TEST,
+						  (COORD_2D) {.x = 0, .y = 0}, MAX_SHIFT_LOCAL_TEST,
+						  &flow);
+	printf("epzs best shift = [%ld %ld] evaluations %lu (full search %d)\n", best_shift.x, best_shift.y,
+	       flow.cost_evaluations, (2 * MAX_SHIFT_LOCAL_TEST + 1) * (2 * MAX_SHIFT_LOCAL_TEST + 1) + 1);
+
+
+	// cost of known shift: pixels of row addressed by offset, row clipped by edge of image
+	for (int y = 0; y < IMG_SIZE; y++) {
+		for (int x = 0; x < IMG_SIZE; x++) {
+			image_texture[y * IMG_SIZE + x] = (x * 37 + y * 91 + x * y * 13) % 200 + 20;
+			image_texture_moved[y * IMG_SIZE + x] = 0;
+		}
+	}
+	for (int y = 1; y < IMG_SIZE; y++) {
+		for (int x = 2; x < IMG_SIZE; x++) {
+			image_texture_moved[y * IMG_SIZE + x] = image_texture[(y - 1) * IMG_SIZE + x - 2];
+		}
+	}
+	old_image->lpData = image_texture;
+	raw_image->lpData = image_texture_moved;
+	printf("moved block: cost %.2f (expected 0.00; cumulative offset of pixels in row: 13.18)\n",
+	       diff_block (old_image, raw_image, gui_image, (COORD_2D) {.x = 2, .y = 2}, (COORD_2D) {.x = 2, .y = 1}, BLOCK_SIZE_TEST));
+	raw_image->lpData = image_texture;
+	printf("left edge:   cost %.2f (expected 89.68; row out of left edge skipped: 0.00)\n",
+	       diff_block (old_image, raw_image, gui_image, (COORD_2D) {.x = 0, .y = 0}, (COORD_2D) {.x = -1, .y = 0}, BLOCK_SIZE_TEST));
+	raw_image->lpData = image_a1;
+	old_image->lpData = image_a0;
 	
 
 
 	block_matching_full_images (old_image, raw_image, gui_image, &flow);
 	print_image (gui_image);
 
+
+
+	// statistics of frame: one pass of optimized block matching (random search stopped at once)
+	flow.old_image = old_image;
+	flow.raw_image = raw_image;
+	flow.gui_image = NULL;
+	atomic_store(&flow.semaphore_optical_flow, false);
+	for (unsigned long int i = 0; i < flow.array_size; i++) {
+		flow.array[i].shift = (COORD_2D) {.x = 0, .y = 0};
+		flow.array[i].last_update = OPTICAL_FLOW_JUST_UPDATED; // not searched again
+	}
+	flow.array[0].shift = (COORD_2D) {.x = 3, .y = 0};
+	flow.array[1].shift = (COORD_2D) {.x = 2, .y = 1};
+	block_matching_optimized_images (&flow);
+	printf("\nexpected: moving 2/4 mean shift [2.50 0.50] direction 0 bbox [0 0 1 0] stale 0\n");
+	print_flow_summary (stdout, 1, 0.0, &flow);
+	flow.old_image = NULL; // not owned by flow: not free in free_block_matching
+
+
+
+	// shared memory ring: writer and reader in one process
+	SHM_RING ring;
+	SHM_RING_MAP ring_map;
+	flow.raw_image = raw_image;
+	init_shm_ring (&ring, "/optical-flow-unit-testing", 2, true);
+	for (int frame = 0; frame < 3; frame++) {
+		flow.array[0].shift.x = frame;
+		write_shm_ring (&ring, frame, &flow);
+	}
+	if (open_shm_ring ("/optical-flow-unit-testing", &ring_map) == 0) {
+		uint64_t seq = wait_shm_ring (&ring_map, 0, 0);
+		SHM_RING_SLOT* slot = get_shm_ring_slot (&ring_map, seq);
+		SHM_RING_SLOT* lost = get_shm_ring_slot (&ring_map, seq - 2); // overwritten: 2 slots
+		unsigned char *luma = get_shm_ring_luma (&ring_map, slot);
+		printf("shm ring: seq = %lu frame = %ld shift_x = %d luma[54] = %d (expected 7) lost = %s consistent = %d\n",
+		       (unsigned long int)seq, (long int)slot->frame_number, get_shm_ring_blocks (&ring_map, slot)[0].shift_x,
+		       luma[54], (lost == NULL) ? "NULL" : "slot", check_shm_ring_slot (slot, seq));
+		close_shm_ring_map (&ring_map);
+	} else {
+		printf("shm ring: ERROR could not open\n");
+	}
+	close_shm_ring (&ring);
+
+
+
+	// flow file: writer and reader (memory mapped), shift of frame 2 out of int8 range (saturated)
+	char *flow_file_name = "/tmp/optical-flow-unit-testing.oflow";
+	uint32_t flow_file_flags[2] = {FLOW_FILE_COST | FLOW_FILE_AGE, FLOW_FILE_INT16 | FLOW_FILE_COST | FLOW_FILE_AGE};
+	for (int f = 0; f < 2; f++) {
+		FLOW_FILE file;
+		FLOW_FILE_MAP file_map;
+		init_flow_file (&file, flow_file_name, flow_file_flags[f]);
+		for (int frame = 0; frame < 3; frame++) {
+			flow.array[3].shift = (COORD_2D) {.x = 70 * frame, .y = -70 * frame};
+			flow.array[3].diff = 1.5;
+			flow.array[3].last_update = frame + 1;
+			write_flow_frame (&file, frame + 10, &flow);
+		}
+		close_flow_file (&file);
+		if (map_flow_file (flow_file_name, &file_map) == 0) {
+			FLOW_FRAME_HEADER* frame = get_flow_frame (&file_map, 2);
+			int int16 = (file_map.header->flags & FLOW_FILE_INT16) != 0;
+			long int shift_x = int16 ? ((int16_t*)get_flow_plane (&file_map, frame, FLOW_PLANE_SHIFT_X))[3] :
+				((int8_t*)get_flow_plane (&file_map, frame, FLOW_PLANE_SHIFT_X))[3];
+			long int shift_y = int16 ? ((int16_t*)get_flow_plane (&file_map, frame, FLOW_PLANE_SHIFT_Y))[3] :
+				((int8_t*)get_flow_plane (&file_map, frame, FLOW_PLANE_SHIFT_Y))[3];
+			printf("flow file %s: frames %lu index %s offset[2] = %lu (expected %lu) frame %ld shift [%ld %ld] (expected %s) cost %d (expected 384) age %d (expected 3)\n",
+			       int16 ? "int16" : "int8", (unsigned long int)file_map.frame_count, (file_map.index != NULL) ? "yes" : "NULL",
+			       (unsigned long int)((unsigned char*)frame - file_map.map),
+			       (unsigned long int)(sizeof(FLOW_FILE_HEADER) + 2 * file_map.header->frame_size),
+			       (long int)frame->frame_number, shift_x, shift_y, int16 ? "[140 -140]" : "[127 -128]",
+			       ((uint16_t*)get_flow_plane (&file_map, frame, FLOW_PLANE_COST))[3],
+			       ((uint8_t*)get_flow_plane (&file_map, frame, FLOW_PLANE_AGE))[3]);
+			unmap_flow_file (&file_map);
+		} else {
+			printf("flow file: ERROR could not map\n");
+		}
+	}
+
+	// flow file not closed (writer still running or killed): no trailer, frames found by fixed size of records
+	FLOW_FILE open_file;
+	FLOW_FILE_MAP open_map;
+	init_flow_file (&open_file, flow_file_name, 0);
+	write_flow_frame (&open_file, 1, &flow);
+	write_flow_frame (&open_file, 2, &flow);
+	fflush(open_file.fp);
+	if (map_flow_file (flow_file_name, &open_map) == 0) {
+		FLOW_FRAME_HEADER* frame = get_flow_frame (&open_map, 1);
+		printf("flow file not closed: frames %lu (expected 2) index %s (expected NULL) frame %ld (expected 2) frame 2 %s (expected NULL) cost plane %s (expected NULL)\n",
+		       (unsigned long int)open_map.frame_count, (open_map.index != NULL) ? "yes" : "NULL",
+		       (frame != NULL) ? (long int)frame->frame_number : -1L,
+		       (get_flow_frame (&open_map, 2) != NULL) ? "found" : "NULL",
+		       (frame != NULL && get_flow_plane (&open_map, frame, FLOW_PLANE_COST) != NULL) ? "found" : "NULL");
+		unmap_flow_file (&open_map);
+	} else {
+		printf("flow file not closed: ERROR could not map\n");
+	}
+	close_flow_file (&open_file);
+	unlink(flow_file_name);
+
+
+
+	// adaptive partition: static scene (large leaves) with one moving object (split up to blocks)
+	// texture: smoothed noise of LCG (reproducible), object: inverted texture of corner of scene
+	unsigned int lcg = 1;
+	for (int i = 0; i < SCENE_WIDTH * SCENE_HEIGHT; i++) {
+		lcg = lcg * 1103515245 + 12345;
+		scene_old[i] = (lcg >> 16) & 0xff;
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = SCENE_WIDTH + 1; i < SCENE_WIDTH * (SCENE_HEIGHT - 1) - 1; i++) {
+			scene_old[i] = (scene_old[i - 1] + scene_old[i + 1] + scene_old[i - SCENE_WIDTH] + scene_old[i + SCENE_WIDTH]) / 4;
+		}
+	}
+	memcpy(scene_new, scene_old, sizeof(scene_new));
+	for (int y = 0; y < OBJECT_SIZE; y++) {
+		for (int x = 0; x < OBJECT_SIZE; x++) {
+			unsigned char object = 255 - scene_old[(8 + y) * SCENE_WIDTH + 8 + x];
+			scene_old[(160 + y) * SCENE_WIDTH + 200 + x] = object;
+			scene_new[(161 + y) * SCENE_WIDTH + 202 + x] = object;
+		}
+	}
+	struct imgRawImage scene_old_image = {.numComponents = 1, .width = SCENE_WIDTH, .height = SCENE_HEIGHT,
+					      .dwBufferBytes = SCENE_WIDTH * SCENE_HEIGHT, .lpData = scene_old};
+	struct imgRawImage scene_new_image = scene_old_image;
+	scene_new_image.lpData = scene_new;
+
+	OPTICAL_FLOW scene_flow;
+	quadtree_size = 64;
+	for (search_mode = SEARCH_FULL; search_mode <= SEARCH_EPZS; search_mode++) {
+		init_block_matching (SCENE_WIDTH, SCENE_HEIGHT, BLOCK_SIZE_TEST,
+				     MAX_SHIFT_GLOBAL_TEST, MAX_SHIFT_LOCAL_TEST,
+				     OPTICAL_FLOW_EPSILON, OPTICAL_FLOW_HISTOGRAM_EPSILON, OPTICAL_FLOW_THRESHOLD, OPTICAL_FLOW_MIN_NEIGHBOURS, OPTICAL_FLOW_LONG_TIME_WITHOUT_UPDATE, OPTICAL_FLOW_PAINTED_BY_NEIGHBOR,
+				     &scene_flow);
+		scene_flow.old_image = &scene_old_image;
+		scene_flow.raw_image = &scene_new_image;
+		scene_flow.gui_image = NULL;
+		scene_flow.cost_evaluations = 0;
+		quadtree_partition (&scene_flow, false);
+
+		unsigned long int moving = 0;
+		printf("\nquadtree (%s): leaves %lu evaluations %lu\n", (search_mode == SEARCH_EPZS) ? "epzs" : "full",
+		       scene_flow.leaf_count, scene_flow.cost_evaluations);
+		for (unsigned long int i = 0; i < scene_flow.leaf_count; i++) {
+			QUADTREE_LEAF* leaf = &scene_flow.leaves[i];
+			if (leaf->shift.x != 0 || leaf->shift.y != 0) {
+				printf("leaf [%lu %lu] size %d shift [%ld %ld]\n", leaf->block.x, leaf->block.y, leaf->size, leaf->shift.x, leaf->shift.y);
+				moving++;
+			}
+		}
+		printf("moving leaves %lu (expected: leaves 75, moving leaves 16 --- blocks [25..28 20..23] size 1 shift [2 1])\n", moving);
+		scene_flow.old_image = NULL; // not owned by flow: not free in free_block_matching
+		free_block_matching (&scene_flow);
+	}
+	quadtree_size = 0;
+	search_mode = SEARCH_FULL;
+
 	free(gui_image->lpData);
 	free_block_matching (&flow);
 	return 0;
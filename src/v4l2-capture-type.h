@@ -0,0 +1,33 @@
+/** \file
+   v4l2-capture-type.h --- header for v4l2-capture.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef V4L2_CAPTURE_TYPE_H
+#define V4L2_CAPTURE_TYPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum v4l2_format_select {V4L2_FORMAT_NONE, V4L2_FORMAT_AUTO, V4L2_FORMAT_YUYV, V4L2_FORMAT_GREY};
+
+typedef struct v4l2_mmap_buffer {
+	void *start;
+	size_t length;
+} V4L2_MMAP_BUFFER;
+
+typedef struct v4l2_capture {
+	int fd;
+	unsigned int n_buffers;
+	V4L2_MMAP_BUFFER *buffers;
+	int width;
+	int height;
+	uint32_t pixelformat;          // V4L2_PIX_FMT_YUYV or V4L2_PIX_FMT_GREY
+	int bytesperline;
+} V4L2_CAPTURE;
+
+#endif /* V4L2_CAPTURE_TYPE_H */
@@ -0,0 +1,407 @@
+/** \file
+v4l2-capture.c --- capture from camera by V4L2 streaming I/O (memory mapped buffers)
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: v4l2 camera webcam mmap yuyv grey
+
+Usage:
+    ./optical_flow -y -d /dev/video0
+    ./optical_flow --v4l2 grey -s 320x240 -d /dev/video0
+
+    Test without camera:
+    sudo modprobe vivid
+    or
+    sudo modprobe v4l2loopback; ffmpeg -re -i video.mp4 -f v4l2 -pix_fmt yuyv422 /dev/video0
+
+    Frames are not decoded and not converted: buffer of driver given
+    to process_image() as AVFrame view, only luma used (gray image).
+    View is copied (flipped, luma of YUYV extracted) into buffer of
+    previous image before buffer is queued again (see frame_into_image).
+
+History:
+    based on V4L2 video capture example
+    https://www.kernel.org/doc/html/latest/userspace-api/media/v4l/capture.c.html
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include <libavutil/frame.h>
+
+#include "const.h"
+#include "v4l2-capture.h"
+#include "image.h"
+#include "block-matching.h"
+
+
+
+static int xioctl (int fh, unsigned long int request, void *arg)
+{
+	int r;
+
+	do {
+		r = ioctl(fh, request, arg);
+	} while (-1 == r && EINTR == errno);
+
+	return r;
+}
+
+
+
+/**
+   \return V4L2_FORMAT_NONE if name unknown
+*/
+int get_v4l2_format (char *name)
+{
+	if (strcmp(name, "auto") == 0) return V4L2_FORMAT_AUTO;
+	if (strcmp(name, "yuyv") == 0) return V4L2_FORMAT_YUYV;
+	if (strcmp(name, "grey") == 0 || strcmp(name, "gray") == 0) return V4L2_FORMAT_GREY;
+	return V4L2_FORMAT_NONE;
+}
+
+
+
+int open_v4l2_device (char *dev_name, V4L2_CAPTURE* cap)
+{
+	struct stat st;
+
+	memset(cap, 0, sizeof(V4L2_CAPTURE));
+	cap->fd = -1;
+
+	if (-1 == stat(dev_name, &st)) {
+		printf("Cannot identify '%s': %d, %s\n", dev_name, errno, strerror(errno));
+		return -1;
+	}
+
+	if (!S_ISCHR(st.st_mode)) {
+		printf("%s is no device\n", dev_name);
+		return -1;
+	}
+
+	cap->fd = open(dev_name, O_RDWR | O_NONBLOCK, 0);
+	if (-1 == cap->fd) {
+		printf("Cannot open '%s': %d, %s\n", dev_name, errno, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+static int set_v4l2_format (V4L2_CAPTURE* cap, int width, int height, uint32_t pixelformat)
+{
+	struct v4l2_format fmt;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.fmt.pix.width       = width;
+	fmt.fmt.pix.height      = height;
+	fmt.fmt.pix.pixelformat = pixelformat;
+	fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_S_FMT, &fmt)) return -1;
+	// driver may change size and format
+	if (fmt.fmt.pix.pixelformat != pixelformat) return -1;
+
+	cap->width = fmt.fmt.pix.width;
+	cap->height = fmt.fmt.pix.height;
+	cap->pixelformat = fmt.fmt.pix.pixelformat;
+	cap->bytesperline = fmt.fmt.pix.bytesperline;
+	return 0;
+}
+
+
+
+/**
+   \param format V4L2_FORMAT_AUTO: GREY if camera support it, else YUYV
+*/
+int init_v4l2_device (V4L2_CAPTURE* cap, int width, int height, int format)
+{
+	struct v4l2_capability capability;
+	struct v4l2_requestbuffers req;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_QUERYCAP, &capability)) {
+		printf("not V4L2 device: %d, %s\n", errno, strerror(errno));
+		return -1;
+	}
+
+	if (!(capability.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
+		printf("not video capture device\n");
+		return -1;
+	}
+
+	if (!(capability.capabilities & V4L2_CAP_STREAMING)) {
+		printf("device does not support streaming i/o\n");
+		return -1;
+	}
+
+	int ret = -1;
+	if (format == V4L2_FORMAT_GREY || format == V4L2_FORMAT_AUTO) {
+		ret = set_v4l2_format(cap, width, height, V4L2_PIX_FMT_GREY);
+	}
+	if (ret != 0 && (format == V4L2_FORMAT_YUYV || format == V4L2_FORMAT_AUTO)) {
+		ret = set_v4l2_format(cap, width, height, V4L2_PIX_FMT_YUYV);
+	}
+	if (ret != 0) {
+		printf("device does not support %s format\n", (format == V4L2_FORMAT_YUYV) ? "YUYV" : ((format == V4L2_FORMAT_GREY) ? "GREY" : "YUYV or GREY"));
+		return -1;
+	}
+	printf("V4L2: %d x %d %s\n", cap->width, cap->height, (cap->pixelformat == V4L2_PIX_FMT_GREY) ? "GREY" : "YUYV");
+
+	memset(&req, 0, sizeof(req));
+	req.count = V4L2_BUFFER_COUNT;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_MMAP;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_REQBUFS, &req)) {
+		printf("device does not support memory mapping: %d, %s\n", errno, strerror(errno));
+		return -1;
+	}
+
+	if (req.count < 2) {
+		printf("insufficient buffer memory\n");
+		return -1;
+	}
+
+	cap->buffers = (V4L2_MMAP_BUFFER*)calloc(req.count, sizeof(V4L2_MMAP_BUFFER));
+	if (!cap->buffers) {
+		printf("out of memory\n");
+		return -1;
+	}
+
+	for (cap->n_buffers = 0; cap->n_buffers < req.count; cap->n_buffers++) {
+		struct v4l2_buffer buf;
+
+		memset(&buf, 0, sizeof(buf));
+		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index  = cap->n_buffers;
+
+		if (-1 == xioctl(cap->fd, VIDIOC_QUERYBUF, &buf)) {
+			printf("VIDIOC_QUERYBUF error %d, %s\n", errno, strerror(errno));
+			return -1;
+		}
+
+		cap->buffers[cap->n_buffers].length = buf.length;
+		cap->buffers[cap->n_buffers].start = mmap(NULL, buf.length,
+							  PROT_READ | PROT_WRITE, MAP_SHARED,
+							  cap->fd, buf.m.offset);
+
+		if (MAP_FAILED == cap->buffers[cap->n_buffers].start) {
+			printf("mmap error %d, %s\n", errno, strerror(errno));
+			cap->buffers[cap->n_buffers].start = NULL;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+int start_v4l2_capturing (V4L2_CAPTURE* cap)
+{
+	enum v4l2_buf_type type;
+
+	for (unsigned int i = 0; i < cap->n_buffers; i++) {
+		struct v4l2_buffer buf;
+
+		memset(&buf, 0, sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = i;
+
+		if (-1 == xioctl(cap->fd, VIDIOC_QBUF, &buf)) {
+			printf("VIDIOC_QBUF error %d, %s\n", errno, strerror(errno));
+			return -1;
+		}
+	}
+
+	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (-1 == xioctl(cap->fd, VIDIOC_STREAMON, &type)) {
+		printf("VIDIOC_STREAMON error %d, %s\n", errno, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+/**
+   Wait and dequeue filled buffer, buffer owned by caller until release_v4l2_frame
+
+   \return 0 if frame read, -1 on error or timeout
+*/
+int read_v4l2_frame (V4L2_CAPTURE* cap, struct v4l2_buffer *buf)
+{
+	for (;;) {
+		fd_set fds;
+		struct timeval tv;
+
+		FD_ZERO(&fds);
+		FD_SET(cap->fd, &fds);
+
+		tv.tv_sec = V4L2_TIMEOUT_SECONDS;
+		tv.tv_usec = 0;
+
+		int r = select(cap->fd + 1, &fds, NULL, NULL, &tv);
+		if (-1 == r) {
+			if (EINTR == errno) continue;
+			printf("select error %d, %s\n", errno, strerror(errno));
+			return -1;
+		}
+		if (0 == r) {
+			printf("select timeout\n");
+			return -1;
+		}
+
+		memset(buf, 0, sizeof(struct v4l2_buffer));
+		buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf->memory = V4L2_MEMORY_MMAP;
+
+		if (-1 == xioctl(cap->fd, VIDIOC_DQBUF, buf)) {
+			if (EAGAIN == errno) continue;
+			printf("VIDIOC_DQBUF error %d, %s\n", errno, strerror(errno));
+			return -1;
+		}
+
+		if (buf->index >= cap->n_buffers) return -1;
+		return 0;
+	}
+}
+
+
+
+/**
+   Return buffer to driver queue
+*/
+int release_v4l2_frame (V4L2_CAPTURE* cap, struct v4l2_buffer *buf)
+{
+	if (-1 == xioctl(cap->fd, VIDIOC_QBUF, buf)) {
+		printf("VIDIOC_QBUF error %d, %s\n", errno, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+
+
+void stop_v4l2_capturing (V4L2_CAPTURE* cap)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (-1 == xioctl(cap->fd, VIDIOC_STREAMOFF, &type)) {
+		printf("VIDIOC_STREAMOFF error %d, %s\n", errno, strerror(errno));
+	}
+}
+
+
+
+void close_v4l2_device (V4L2_CAPTURE* cap)
+{
+	if (cap->buffers != NULL) {
+		for (unsigned int i = 0; i < cap->n_buffers; i++) {
+			if (cap->buffers[i].start != NULL) munmap(cap->buffers[i].start, cap->buffers[i].length);
+		}
+		free(cap->buffers);
+		cap->buffers = NULL;
+	}
+	if (cap->fd != -1) close(cap->fd);
+	cap->fd = -1;
+}
+
+
+
+/**
+   Same as mainloop (see capture.c), but frames are taken from V4L2 buffers without libav
+*/
+int v4l2_mainloop (char *dev_name, int format, int width, int height, int max_frame_count, int compare_with_first, unsigned int video_texture)
+{
+	extern _Atomic int escape_status;
+	extern int verbose;
+
+	V4L2_CAPTURE cap;
+	if (open_v4l2_device(dev_name, &cap) != 0 ||
+	    init_v4l2_device(&cap, width, height, format) != 0 ||
+	    start_v4l2_capturing(&cap) != 0) {
+		close_v4l2_device(&cap);
+		return EXIT_FAILURE;
+	}
+
+	// view: point into buffer of driver, not own data
+	AVFrame *pFrameView = av_frame_alloc();
+	if (!pFrameView) {
+		printf("failed to allocated memory for AVFrame\n");
+		stop_v4l2_capturing(&cap);
+		close_v4l2_device(&cap);
+		return EXIT_FAILURE;
+	}
+	pFrameView->width = cap.width;
+	pFrameView->height = cap.height;
+	pFrameView->linesize[0] = cap.bytesperline;
+	pFrameView->format = (cap.pixelformat == V4L2_PIX_FMT_GREY) ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_YUYV422;
+	int num_components = 1; // luma only
+
+	OPTICAL_FLOW flow;
+	init_block_matching (cap.width, cap.height,
+			     OPTICAL_FLOW_BLOCK_SIZE, OPTICAL_FLOW_MAX_SHIFT_GLOBAL, OPTICAL_FLOW_MAX_SHIFT_LOCAL,
+			     OPTICAL_FLOW_EPSILON, OPTICAL_FLOW_HISTOGRAM_EPSILON,
+			     OPTICAL_FLOW_THRESHOLD,
+			     OPTICAL_FLOW_MIN_NEIGHBOURS,
+			     OPTICAL_FLOW_LONG_TIME_WITHOUT_UPDATE,
+			     OPTICAL_FLOW_PAINTED_BY_NEIGHBOR,
+			     &flow);
+
+	int frame_counter = 0;
+	struct v4l2_buffer buf;
+	while (max_frame_count != 0 && atomic_load(&escape_status) == false &&
+	       read_v4l2_frame(&cap, &buf) == 0) { // max_frame_count == -1 infinity; > 0 limited frame number; == 0 exit
+		frame_counter++;
+		pFrameView->data[0] = cap.buffers[buf.index].start;
+		pFrameView->pts = (int64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec; // microseconds, time of capture
+		process_image(pFrameView, NULL, frame_counter, compare_with_first, verbose, video_texture, num_components, &flow);
+		printf(" %d=", frame_counter);
+		if (release_v4l2_frame(&cap, &buf) != 0) break;
+		if (max_frame_count > 0) max_frame_count--;
+	}
+
+	free_block_matching (&flow);
+	av_frame_free(&pFrameView);
+	stop_v4l2_capturing(&cap);
+	close_v4l2_device(&cap);
+	return 0;
+}
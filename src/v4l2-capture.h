@@ -0,0 +1,27 @@
+/** \file
+   v4l2-capture.h --- header for v4l2-capture.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef V4L2_CAPTURE_H
+#define V4L2_CAPTURE_H
+
+#include <linux/videodev2.h>
+
+#include "v4l2-capture-type.h"
+
+int get_v4l2_format (char *name);
+int open_v4l2_device (char *dev_name, V4L2_CAPTURE* cap);
+int init_v4l2_device (V4L2_CAPTURE* cap, int width, int height, int format);
+int start_v4l2_capturing (V4L2_CAPTURE* cap);
+int read_v4l2_frame (V4L2_CAPTURE* cap, struct v4l2_buffer *buf);
+int release_v4l2_frame (V4L2_CAPTURE* cap, struct v4l2_buffer *buf);
+void stop_v4l2_capturing (V4L2_CAPTURE* cap);
+void close_v4l2_device (V4L2_CAPTURE* cap);
+int v4l2_mainloop (char *dev_name, int format, int width, int height, int max_frame_count, int compare_with_first, unsigned int video_texture);
+
+#endif /* V4L2_CAPTURE_H */
@@ -0,0 +1,51 @@
+/** \file
+   video-writer-type.h --- header for video-writer.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef VIDEO_WRITER_TYPE_H
+#define VIDEO_WRITER_TYPE_H
+
+#include <pthread.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+
+#include "image-type.h"
+
+typedef struct video_writer {
+	char *file_name;  // container selected by extension (.mp4, .mkv, ...)
+	char *codec_name; // NULL === default codec of container
+	int fps;
+
+	// encoder created by first image: size of image unknown before
+	AVFormatContext *pFormatContext;
+	AVCodecContext *pCodecContext;
+	AVStream *pStream;
+	AVFrame *pFrame;
+	AVPacket *pPacket;
+	struct SwsContext *sws_ctx;
+	int64_t first_time; // of first frame with known time (microseconds, AV_NOPTS_VALUE === not yet): video start from zero
+	int64_t next_pts;   // at least for next frame (in time base of encoder): pts strictly increase
+	int failed;       // encoder can not be created: images only dropped
+
+	// queue of images: one encoder thread keep order of frames
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	struct imgRawImage** queue; // ring buffer, images owned by queue
+	int64_t* queue_time;        // time of queued images (microseconds, AV_NOPTS_VALUE === unknown)
+	int capacity;
+	int head;
+	int count;
+	int closed;
+	pthread_t thread;
+
+	unsigned long int encoded;
+} VIDEO_WRITER;
+
+#endif /* VIDEO_WRITER_TYPE_H */
@@ -0,0 +1,348 @@
+/** \file
+video-writer.c --- encode drawn images (optical flow) into video file by background thread
+
+Copyright (C) 2022 Roman V. Prikhodchenko
+
+Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+
+
+    This file is part of optical-flow.
+
+    optical-flow is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    optical-flow is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with optical-flow.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+Keywords: video encoder x264 mp4 mkv thread
+
+Usage:
+    ./optical_flow --video-out /tmp/flow.mkv -d record.mp4
+    ./optical_flow --video-out /tmp/flow.mp4 --video-codec libx264 --video-fps 15 -d /dev/video0
+
+    init_video_writer()    start encoder thread (encoder itself created by first image)
+    video_writer_submit()  give image (ownership) and time of frame to queue, wait only if queue full
+    close_video_writer()   encode all queued images, flush encoder, write trailer
+
+    Images stored bottom-up (see frame_to_image): flipped by negative
+    linesize while converted from RGB to YUV.
+
+    Time of frame (pts of source in microseconds) rescaled to time base
+    of encoder (1 / --video-fps): skipped and dropped frames keep real
+    playback speed. Frame without time (raw input) === next frame.
+
+History:
+    https://github.com/FFmpeg/FFmpeg/blob/master/doc/examples/mux.c
+
+Code:
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <libavutil/opt.h>
+
+#include "const.h"
+#include "video-writer.h"
+#include "image.h"
+
+
+
+int init_video_writer (VIDEO_WRITER* writer, char *file_name, char *codec_name, int fps, int capacity)
+{
+	writer->file_name = file_name;
+	writer->codec_name = codec_name;
+	writer->fps = (fps > 0) ? fps : OPTICAL_FLOW_FPS;
+
+	writer->pFormatContext = NULL;
+	writer->pCodecContext = NULL;
+	writer->pStream = NULL;
+	writer->pFrame = NULL;
+	writer->pPacket = NULL;
+	writer->sws_ctx = NULL;
+	writer->first_time = AV_NOPTS_VALUE;
+	writer->next_pts = 0;
+	writer->failed = false;
+	writer->encoded = 0;
+
+	writer->capacity = (capacity > 0) ? capacity : 1;
+	writer->queue = (struct imgRawImage**) calloc(writer->capacity, sizeof(struct imgRawImage*));
+	writer->queue_time = (int64_t*) calloc(writer->capacity, sizeof(int64_t));
+	if (writer->queue == NULL || writer->queue_time == NULL) {
+		printf("failed to allocated memory for video writer\n");
+		free(writer->queue);
+		free(writer->queue_time);
+		return -1;
+	}
+	writer->head = 0;
+	writer->count = 0;
+	writer->closed = false;
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->not_empty, NULL);
+	pthread_cond_init(&writer->not_full, NULL);
+
+	if (pthread_create(&writer->thread, NULL, video_writer_thread, writer) != 0) {
+		printf("video writer: can not create thread\n");
+		free(writer->queue);
+		free(writer->queue_time);
+		return -1;
+	}
+	return 0;
+}
+
+
+
+static void free_image (struct imgRawImage* image)
+{
+	free(image->lpData);
+	free(image);
+}
+
+
+
+/**
+   Queue take ownership of image. Frames of video must not be lost, so
+   processing wait if encoder slower (backpressure).
+
+   \param time of frame in microseconds (pts of source), AV_NOPTS_VALUE === unknown (next frame at --video-fps)
+*/
+void video_writer_submit (VIDEO_WRITER* writer, struct imgRawImage* image, int64_t time)
+{
+	pthread_mutex_lock(&writer->mutex);
+	while (writer->count == writer->capacity) {
+		pthread_cond_wait(&writer->not_full, &writer->mutex);
+	}
+	writer->queue[(writer->head + writer->count) % writer->capacity] = image;
+	writer->queue_time[(writer->head + writer->count) % writer->capacity] = time;
+	writer->count++;
+	pthread_cond_signal(&writer->not_empty);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+
+
+/**
+   Send frame (NULL === flush) to encoder and write all ready packets
+*/
+static int encode_frame (VIDEO_WRITER* writer, AVFrame *pFrame)
+{
+	int response = avcodec_send_frame(writer->pCodecContext, pFrame);
+	if (response < 0) {
+		printf("video writer: error while sending a frame to the encoder: %s\n", av_err2str(response));
+		return response;
+	}
+
+	while (response >= 0) {
+		response = avcodec_receive_packet(writer->pCodecContext, writer->pPacket);
+		if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+			break;
+		} else if (response < 0) {
+			printf("video writer: error while receiving a packet from the encoder: %s\n", av_err2str(response));
+			return response;
+		}
+
+		av_packet_rescale_ts(writer->pPacket, writer->pCodecContext->time_base, writer->pStream->time_base);
+		writer->pPacket->stream_index = writer->pStream->index;
+		response = av_interleaved_write_frame(writer->pFormatContext, writer->pPacket); // packet unreferenced
+		if (response < 0) {
+			printf("video writer: error while writing a packet: %s\n", av_err2str(response));
+			return response;
+		}
+	}
+	return 0;
+}
+
+
+
+/**
+   Create container, stream and encoder for images of known size
+*/
+static int open_video_encoder (VIDEO_WRITER* writer, int width, int height)
+{
+	int result = avformat_alloc_output_context2(&writer->pFormatContext, NULL, NULL, writer->file_name);
+	if (result < 0 || writer->pFormatContext == NULL) {
+		printf("video writer: unknown container of %s\n", writer->file_name);
+		return -1;
+	}
+
+	const AVCodec *pCodec = (writer->codec_name != NULL) ?
+		avcodec_find_encoder_by_name(writer->codec_name) :
+		avcodec_find_encoder(writer->pFormatContext->oformat->video_codec);
+	if (pCodec == NULL) {
+		printf("video writer: encoder %s not found\n", (writer->codec_name != NULL) ? writer->codec_name : "of container");
+		return -1;
+	}
+
+	writer->pStream = avformat_new_stream(writer->pFormatContext, NULL);
+	writer->pCodecContext = avcodec_alloc_context3(pCodec);
+	writer->pFrame = av_frame_alloc();
+	writer->pPacket = av_packet_alloc();
+	if (writer->pStream == NULL || writer->pCodecContext == NULL ||
+	    writer->pFrame == NULL || writer->pPacket == NULL) {
+		printf("video writer: failed to allocated memory for encoder\n");
+		return -1;
+	}
+
+	// 4:2:0 need even size
+	writer->pCodecContext->width = width & ~1;
+	writer->pCodecContext->height = height & ~1;
+	writer->pCodecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+	writer->pCodecContext->time_base = (AVRational) {1, writer->fps};
+	writer->pCodecContext->framerate = (AVRational) {writer->fps, 1};
+	writer->pCodecContext->gop_size = 10 * writer->fps;
+	if (writer->pFormatContext->oformat->flags & AVFMT_GLOBALHEADER) {
+		writer->pCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+	// x264: not slow down processing, quality enough for visualization (ignored by other encoders)
+	av_opt_set(writer->pCodecContext->priv_data, "preset", "veryfast", 0);
+	av_opt_set(writer->pCodecContext->priv_data, "crf", "26", 0);
+
+	result = avcodec_open2(writer->pCodecContext, pCodec, NULL);
+	if (result < 0) {
+		printf("video writer: failed to open encoder %s: %s\n", pCodec->name, av_err2str(result));
+		return -1;
+	}
+
+	if (avcodec_parameters_from_context(writer->pStream->codecpar, writer->pCodecContext) < 0) {
+		printf("video writer: failed to copy encoder parameters\n");
+		return -1;
+	}
+	writer->pStream->time_base = writer->pCodecContext->time_base;
+
+	writer->pFrame->format = writer->pCodecContext->pix_fmt;
+	writer->pFrame->width = writer->pCodecContext->width;
+	writer->pFrame->height = writer->pCodecContext->height;
+	if (av_frame_get_buffer(writer->pFrame, 0) < 0) {
+		printf("video writer: failed to allocated frame buffer\n");
+		return -1;
+	}
+
+	if (!(writer->pFormatContext->oformat->flags & AVFMT_NOFILE)) {
+		result = avio_open(&writer->pFormatContext->pb, writer->file_name, AVIO_FLAG_WRITE);
+		if (result < 0) {
+			printf("video writer: could not open %s: %s\n", writer->file_name, av_err2str(result));
+			return -1;
+		}
+	}
+
+	result = avformat_write_header(writer->pFormatContext, NULL);
+	if (result < 0) {
+		printf("video writer: error while writing header: %s\n", av_err2str(result));
+		return -1;
+	}
+
+	printf("video writer: %s %d x %d, %d fps, codec %s\n", writer->file_name,
+	       writer->pCodecContext->width, writer->pCodecContext->height, writer->fps, pCodec->name);
+	return 0;
+}
+
+
+
+static int encode_image (VIDEO_WRITER* writer, struct imgRawImage* image, int64_t time)
+{
+	writer->sws_ctx = sws_getCachedContext(writer->sws_ctx,
+					       image->width, image->height, AV_PIX_FMT_RGB24,
+					       writer->pFrame->width, writer->pFrame->height, writer->pFrame->format,
+					       SWS_BILINEAR, NULL, NULL, NULL);
+	if (writer->sws_ctx == NULL) return -1;
+
+	if (av_frame_make_writable(writer->pFrame) < 0) return -1;
+
+	// image stored bottom-up: start from last line with negative step
+	int linesize = image->width * image->numComponents;
+	const unsigned char *src_data[1] = {image->lpData + (image->height - 1) * linesize};
+	const int src_linesize[1] = {-linesize};
+	sws_scale(writer->sws_ctx, src_data, src_linesize, 0, image->height,
+		  writer->pFrame->data, writer->pFrame->linesize);
+
+	// time of source rescaled: gaps of dropped, skipped (--every, --time-stride) and not recorded (event mode) frames kept
+	int64_t pts = writer->next_pts;
+	if (time != AV_NOPTS_VALUE) {
+		if (writer->first_time == AV_NOPTS_VALUE) writer->first_time = time;
+		pts = av_rescale_q(time - writer->first_time, (AVRational) {1, 1000000}, writer->pCodecContext->time_base);
+		if (pts < writer->next_pts) pts = writer->next_pts; // faster than --video-fps
+	}
+	writer->pFrame->pts = pts;
+	writer->next_pts = pts + 1;
+	return encode_frame(writer, writer->pFrame);
+}
+
+
+
+void *video_writer_thread (void *vin)
+{
+	VIDEO_WRITER* writer = (VIDEO_WRITER*) vin;
+
+	for (;;) {
+		pthread_mutex_lock(&writer->mutex);
+		while (writer->count == 0 && !writer->closed) {
+			pthread_cond_wait(&writer->not_empty, &writer->mutex);
+		}
+		if (writer->count == 0) { // closed and empty
+			pthread_mutex_unlock(&writer->mutex);
+			break;
+		}
+		struct imgRawImage* image = writer->queue[writer->head];
+		int64_t time = writer->queue_time[writer->head];
+		writer->head = (writer->head + 1) % writer->capacity;
+		writer->count--;
+		pthread_cond_signal(&writer->not_full);
+		pthread_mutex_unlock(&writer->mutex);
+
+		if (writer->pCodecContext == NULL && writer->failed == false) {
+			if (open_video_encoder(writer, image->width, image->height) != 0) {
+				writer->failed = true;
+			}
+		}
+		if (writer->failed == false && image->numComponents == NUM_COMPONENTS_RGB) {
+			if (encode_image(writer, image, time) == 0) writer->encoded++;
+		}
+		free_image(image);
+	}
+
+	return NULL;
+}
+
+
+
+/**
+   Encode all queued images, flush encoder, write trailer and release resources
+*/
+void close_video_writer (VIDEO_WRITER* writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+	writer->closed = true;
+	pthread_cond_broadcast(&writer->not_empty);
+	pthread_mutex_unlock(&writer->mutex);
+	pthread_join(writer->thread, NULL);
+
+	if (writer->pCodecContext != NULL && writer->failed == false) {
+		encode_frame(writer, NULL); // flush delayed frames
+		av_write_trailer(writer->pFormatContext);
+	}
+	printf("video writer: %lu frames encoded\n", writer->encoded);
+
+	if (writer->pFormatContext != NULL) {
+		if (!(writer->pFormatContext->oformat->flags & AVFMT_NOFILE)) avio_closep(&writer->pFormatContext->pb);
+		avformat_free_context(writer->pFormatContext);
+	}
+	avcodec_free_context(&writer->pCodecContext);
+	av_frame_free(&writer->pFrame);
+	av_packet_free(&writer->pPacket);
+	sws_freeContext(writer->sws_ctx);
+
+	pthread_cond_destroy(&writer->not_full);
+	pthread_cond_destroy(&writer->not_empty);
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer->queue);
+	free(writer->queue_time);
+}
@@ -0,0 +1,20 @@
+/** \file
+   video-writer.h --- header for video-writer.c
+
+   Copyright (C) 2022 Roman V. Prikhodchenko
+
+   Author: Roman V. Prikhodchenko <chujoii@gmail.com>
+*/
+
+// include guard
+#ifndef VIDEO_WRITER_H
+#define VIDEO_WRITER_H
+
+#include "video-writer-type.h"
+
+int init_video_writer (VIDEO_WRITER* writer, char *file_name, char *codec_name, int fps, int capacity);
+void video_writer_submit (VIDEO_WRITER* writer, struct imgRawImage* image, int64_t time);
+void *video_writer_thread (void *vin);
+void close_video_writer (VIDEO_WRITER* writer);
+
+#endif /* VIDEO_WRITER_H */